@@ -0,0 +1,339 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/Workers.hpp>
+
+namespace Client
+{
+    // Open loop sends on a fixed schedule whatever the replies, closed loop waits for the reply of the previous message
+    enum class LoadMode
+    {
+        Open,
+        Closed
+    };
+
+    // Echoes over the session, or over the datagram channel once it is bound
+    // Sequenced echoes lost on the way are not sent back, so they run in open loop only
+    enum class EchoTransport
+    {
+        Tcp,
+        Sequenced,
+        Reliable
+    };
+
+    // Payload size of each echo, the first 8 bytes carry the send time
+    class PayloadSizeDistribution
+    {
+    public:
+        enum class Type
+        {
+            Fixed,
+            Uniform,
+            Exponential
+        };
+
+        static constexpr size_t     MinSize     = sizeof(uint64_t);
+        static constexpr size_t     MaxSize     = 512 * 1024;
+
+        PayloadSizeDistribution()
+            : _type(Type::Fixed)
+            , _minSize(MinSize)
+            , _maxSize(MinSize)
+        {}
+
+        // fixed:SIZE, uniform:MIN-MAX or exp:MEAN
+        static PayloadSizeDistribution Parse(const std::string& text)
+        {
+            PayloadSizeDistribution distribution;
+            const size_t colon = text.find(':');
+
+            if (colon == std::string::npos)
+            {
+                throw std::invalid_argument("Invalid payload distribution: " + text);
+            }
+
+            const std::string type = text.substr(0, colon);
+            const std::string value = text.substr(colon + 1);
+
+            if (type == "fixed")
+            {
+                distribution._type = Type::Fixed;
+                distribution._minSize = distribution._maxSize = std::stoul(value);
+            }
+            else if (type == "uniform")
+            {
+                const size_t dash = value.find('-');
+
+                if (dash == std::string::npos)
+                {
+                    throw std::invalid_argument("Invalid uniform payload distribution: " + text);
+                }
+
+                distribution._type = Type::Uniform;
+                distribution._minSize = std::stoul(value.substr(0, dash));
+                distribution._maxSize = std::stoul(value.substr(dash + 1));
+            }
+            else if (type == "exp")
+            {
+                distribution._type = Type::Exponential;
+                distribution._minSize = std::stoul(value);
+                distribution._maxSize = MaxSize;
+            }
+            else
+            {
+                throw std::invalid_argument("Invalid payload distribution: " + text);
+            }
+
+            distribution._minSize = std::min(std::max(distribution._minSize, MinSize), MaxSize);
+            distribution._maxSize = std::min(std::max(distribution._maxSize, distribution._minSize), MaxSize);
+
+            return distribution;
+        }
+
+        size_t Generate() const
+        {
+            thread_local std::mt19937_64 engine(std::random_device{}());
+
+            switch (_type)
+            {
+            case Type::Uniform:
+                return std::uniform_int_distribution<size_t>(_minSize, _maxSize)(engine);
+
+            case Type::Exponential:
+            {
+                // _minSize holds the mean
+                const double size = std::exponential_distribution<double>(1.0 / _minSize)(engine);
+
+                return std::min(std::max(static_cast<size_t>(size), MinSize), _maxSize);
+            }
+
+            default:
+                return _minSize;
+            }
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const PayloadSizeDistribution& distribution)
+        {
+            switch (distribution._type)
+            {
+            case Type::Uniform:
+                os << "uniform:" << distribution._minSize << "-" << distribution._maxSize;
+                break;
+
+            case Type::Exponential:
+                os << "exp:" << distribution._minSize;
+                break;
+
+            default:
+                os << "fixed:" << distribution._minSize;
+                break;
+            }
+
+            return os;
+        }
+
+    private:
+        Type        _type;
+        size_t      _minSize;
+        size_t      _maxSize;
+
+    };
+
+    struct LoadConfig
+    {
+        using Seconds       = std::chrono::seconds;
+
+        std::string                 host                = "127.0.0.1";
+        std::string                 port                = "60000";
+        size_t                      nWorkers            = 4;
+        NetCommon::ExecutionModel   executionModel      = NetCommon::ExecutionModel::ThreadPool;
+        bool                        shouldPinWorkers    = false;
+        uint16_t                    nConnections        = 1000;
+        size_t                      nMaxPendingConnects = 64;
+        // Loopback port of the metrics, 0 disables
+        uint16_t                    statsPort           = 0;
+
+        LoadMode                    mode                = LoadMode::Closed;
+        // Messages per second per connection, in closed loop 0 sends again as soon as the reply arrives
+        double                      rate                = 1.0;
+        PayloadSizeDistribution     payloadSizes;
+        EchoTransport               transport           = EchoTransport::Tcp;
+
+        // Connections start sending spread over the ramp-up, which is not measured
+        Seconds                     rampUp              = Seconds(0);
+        // Measured time after the ramp-up, 0 runs until SIGINT or SIGTERM
+        Seconds                     duration            = Seconds(0);
+        std::string                 summaryPath         = "EchoLatency.txt";
+
+        // Throws std::invalid_argument on an unknown option or an invalid value
+        static LoadConfig Parse(int argc, char* argv[])
+        {
+            LoadConfig config;
+
+            for (int i = 1; i < argc; ++i)
+            {
+                const std::string option = argv[i];
+
+                if (option == "--help")
+                {
+                    throw std::invalid_argument(GetUsage());
+                }
+
+                if (option == "--pin")
+                {
+                    config.shouldPinWorkers = true;
+                    continue;
+                }
+
+                if (i + 1 >= argc)
+                {
+                    throw std::invalid_argument("Missing value: " + option + "\n" + GetUsage());
+                }
+
+                const std::string value = argv[++i];
+
+                if (option == "--host")
+                {
+                    config.host = value;
+                }
+                else if (option == "--port")
+                {
+                    config.port = value;
+                }
+                else if (option == "--workers")
+                {
+                    config.nWorkers = std::max<size_t>(1, std::stoul(value));
+                }
+                else if (option == "--model")
+                {
+                    if (value != "pool" && value != "per-core")
+                    {
+                        throw std::invalid_argument("Invalid model: " + value);
+                    }
+
+                    config.executionModel = (value == "pool") ? NetCommon::ExecutionModel::ThreadPool : 
+                                                                NetCommon::ExecutionModel::IoContextPerCore;
+                }
+                else if (option == "--connections")
+                {
+                    config.nConnections = static_cast<uint16_t>(std::min<unsigned long>(std::max<unsigned long>(1, std::stoul(value)), 
+                                                                                        std::numeric_limits<uint16_t>::max()));
+                }
+                else if (option == "--pending-connects")
+                {
+                    config.nMaxPendingConnects = std::max<size_t>(1, std::stoul(value));
+                }
+                else if (option == "--stats-port")
+                {
+                    config.statsPort = static_cast<uint16_t>(std::stoul(value));
+                }
+                else if (option == "--mode")
+                {
+                    if (value != "open" && value != "closed")
+                    {
+                        throw std::invalid_argument("Invalid mode: " + value);
+                    }
+
+                    config.mode = (value == "open") ? LoadMode::Open : LoadMode::Closed;
+                }
+                else if (option == "--rate")
+                {
+                    config.rate = std::max(0.0, std::stod(value));
+                }
+                else if (option == "--payload")
+                {
+                    config.payloadSizes = PayloadSizeDistribution::Parse(value);
+                }
+                else if (option == "--transport")
+                {
+                    if (value == "tcp")
+                    {
+                        config.transport = EchoTransport::Tcp;
+                    }
+                    else if (value == "sequenced")
+                    {
+                        config.transport = EchoTransport::Sequenced;
+                    }
+                    else if (value == "reliable")
+                    {
+                        config.transport = EchoTransport::Reliable;
+                    }
+                    else
+                    {
+                        throw std::invalid_argument("Invalid transport: " + value);
+                    }
+                }
+                else if (option == "--ramp-up")
+                {
+                    config.rampUp = Seconds(std::stoul(value));
+                }
+                else if (option == "--duration")
+                {
+                    config.duration = Seconds(std::stoul(value));
+                }
+                else if (option == "--summary")
+                {
+                    config.summaryPath = value;
+                }
+                else
+                {
+                    throw std::invalid_argument("Unknown option: " + option + "\n" + GetUsage());
+                }
+            }
+
+            if (config.mode == LoadMode::Open &&
+                config.rate <= 0.0)
+            {
+                throw std::invalid_argument("Open loop needs a rate above 0");
+            }
+
+            // A lost echo would stop its connection for the rest of the run
+            if (config.mode == LoadMode::Closed &&
+                config.transport == EchoTransport::Sequenced)
+            {
+                throw std::invalid_argument("Sequenced echoes need open loop");
+            }
+
+            return config;
+        }
+
+        static std::string GetUsage()
+        {
+            return "Usage: Client [options]\n"
+                   "  --host HOST              server host (127.0.0.1)\n"
+                   "  --port PORT              server port (60000)\n"
+                   "  --workers N              worker threads (4)\n"
+                   "  --model pool|per-core    thread pool with strands or an io_context per worker (pool)\n"
+                   "  --pin                    pin the per-core workers to cpus\n"
+                   "  --connections N          connections (1000)\n"
+                   "  --pending-connects N     connects in flight at once (64)\n"
+                   "  --stats-port PORT        loopback port serving the metrics, 0 disables (0)\n"
+                   "  --mode open|closed       open loop sends on schedule, closed loop waits for replies (closed)\n"
+                   "  --rate R                 messages per second per connection, closed loop 0 is unpaced (1)\n"
+                   "  --payload DIST           fixed:SIZE, uniform:MIN-MAX or exp:MEAN in bytes (fixed:8)\n"
+                   "  --transport T            tcp, or sequenced (open loop)|reliable over the datagram channel (tcp)\n"
+                   "  --ramp-up S              seconds to spread the connection starts over, not measured (0)\n"
+                   "  --duration S             measured seconds after the ramp-up, 0 runs until interrupted (0)\n"
+                   "  --summary PATH           report file (EchoLatency.txt)\n";
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const LoadConfig& config)
+        {
+            os << "Target: " << config.host << ":" << config.port << "\n"
+               << "Workers: " << config.nWorkers 
+               << (config.executionModel == NetCommon::ExecutionModel::ThreadPool ? " pool" : " per-core") 
+               << (config.shouldPinWorkers ? " pinned" : "") << "\n"
+               << "Connections: " << config.nConnections << "\n"
+               << "Pending connects: " << config.nMaxPendingConnects << "\n"
+               << "Mode: " << (config.mode == LoadMode::Open ? "open" : "closed") << "\n"
+               << "Rate: " << config.rate << "/s per connection\n"
+               << "Payload: " << config.payloadSizes << "\n"
+               << "Transport: " << (config.transport == EchoTransport::Tcp ? "tcp" : 
+                                    config.transport == EchoTransport::Sequenced ? "sequenced" : "reliable") << "\n"
+               << "Ramp-up: " << config.rampUp.count() << "s\n"
+               << "Duration: " << config.duration.count() << "s\n";
+
+            return os;
+        }
+    };
+}
@@ -1,12 +1,32 @@
 ﻿#include <Client/Pch.hpp>
 #include <Client/Service.hpp>
 
-int main() 
+int main(int argc, char* argv[]) 
 {
     try
     {
-        Client::Service service(4, 0, 1000);
-        service.Start("127.0.0.1", "60000");
+        const Client::LoadConfig loadConfig = Client::LoadConfig::Parse(argc, argv);
+
+        NetCommon::ServiceConfig config;
+        config.nWorkers = loadConfig.nWorkers;
+        config.executionModel = loadConfig.executionModel;
+        config.shouldPinWorkers = loadConfig.shouldPinWorkers;
+        // Send timers fire on the ticks, so the tick is kept short and sleeps rather than spins
+        config.tickRate = 1000;
+        config.spinThreshold = NetCommon::ServiceConfig::MicroSeconds(0);
+        config.timerResolution = NetCommon::ServiceConfig::MilliSeconds(1);
+        config.heartbeatInterval = NetCommon::ServiceConfig::MilliSeconds(10000);
+        config.nMaxPendingConnects = loadConfig.nMaxPendingConnects;
+        config.statsPort = loadConfig.statsPort;
+        config.nWarmSessions = loadConfig.nConnections;
+        config.sessionFeatures = static_cast<NetCommon::SessionFeatures>(NetCommon::SessionFeature::CompactFraming) |
+                                 static_cast<NetCommon::SessionFeatures>(NetCommon::SessionFeature::Compression) |
+                                 static_cast<NetCommon::SessionFeatures>(NetCommon::SessionFeature::Chunking) |
+                                 static_cast<NetCommon::SessionFeatures>(NetCommon::SessionFeature::Heartbeat) |
+                                 static_cast<NetCommon::SessionFeatures>(NetCommon::SessionFeature::Datagram);
+
+        Client::Service service(config, loadConfig);
+        service.Start(loadConfig.host.c_str(), loadConfig.port.c_str());
         
         service.JoinWorkers();
     }
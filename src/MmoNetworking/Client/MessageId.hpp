@@ -1,11 +1,20 @@
 ﻿#pragma once
 
 #include <NetCommon/Message.hpp>
+#include <NetCommon/MessageDispatcher.hpp>
 
 namespace Client
 {
     enum class MessageId : NetCommon::Message::Id
     {
-        Echo = 1000,
+        Begin = 1000,
+        Echo = Begin,
+        // Echoes sent and sent back over the datagram channel
+        SequencedEcho,
+        ReliableEcho,
+        End,
     };
+
+    static_assert(NetCommon::AreServiceMessageIds<MessageId>(),
+                  "Client message ids collide with the control ids or the compressed flag");
 }
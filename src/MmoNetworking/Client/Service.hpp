@@ -1,166 +1,357 @@
 ﻿#pragma once
 
 #include <NetCommon/ClientServiceBase.hpp>
+#include <NetCommon/MessageDispatcher.hpp>
+#include <NetCommon/MessageWriter.hpp>
+#include <NetCommon/MessageReader.hpp>
+#include <NetCommon/LatencyHistogram.hpp>
 #include <Client/MessageId.hpp>
+#include <Client/LoadConfig.hpp>
 #include <Server/MessageId.hpp>
 
 namespace Client
 {
+    static_assert(NetCommon::AreDisjointMessageIds<Client::MessageId, Server::MessageId>(), 
+                  "Client and Server message ids collide");
+
+    // Load generator, every connection sends echoes carrying their send time and the server sends them back
     class Service : public NetCommon::ClientServiceBase
     {
     private:
         using Message       = NetCommon::Message;
-        using TimePoint     = std::chrono::steady_clock::time_point;
+        using Logger        = NetCommon::Logger;
+        using Dispatcher    = NetCommon::MessageDispatcher<Service, Server::MessageId>;
+        using SignalSet     = boost::asio::signal_set;
+        using Histogram     = NetCommon::LatencyHistogram;
+
+    public:
+        Service(const NetCommon::ServiceConfig& config,
+                const LoadConfig& loadConfig)
+            : ClientServiceBase(config, loadConfig.nConnections)
+            , _loadConfig(loadConfig)
+            , _nStartedSenders(0)
+            , _sendInterval(CalculateSendInterval(loadConfig.rate))
+            , _startTime(Clock::now())
+            , _measureStartTime(_startTime + loadConfig.rampUp)
+            , _latencies(config.nWorkers)
+            , _nSentMessages(0)
+            , _nReceivedMessages(0)
+            , _nReceivedBytes(0)
+            , _reportTimer(_workers.GetExecutor())
+            , _endTimer(_workers.GetExecutor())
+            , _signals(_workers.GetExecutor(), SIGINT, SIGTERM)
+            , _isFinished(false)
+        {
+            WaitReportTimerAsync();
+            WaitEndTimerAsync();
+            WaitSignalAsync();
+        }
 
-        struct EchoTimer
+    protected:
+        // The starts are spread evenly over the ramp-up, reconnected sessions start right away
+        virtual void OnSessionRegistered(SessionPointer pSession) override
         {
-            using Pointer   = std::unique_ptr<EchoTimer>;
-            using Map       = std::unordered_map<SessionId, Pointer>;
+            const Clock::duration rampUpOffset = std::chrono::duration_cast<Clock::duration>(_loadConfig.rampUp) * 
+                                                 static_cast<Clock::rep>(std::min<size_t>(_nStartedSenders, _loadConfig.nConnections)) / 
+                                                 static_cast<Clock::rep>(_loadConfig.nConnections);
+            ++_nStartedSenders;
+
+            const size_t shardIndex = GetLogicShardIndex(pSession->GetId());
+            const SessionHandle handle = pSession->GetHandle();
+            const TimePoint startTime = std::max(Clock::now(), _startTime + rampUpOffset);
 
-            SessionId       id;
-            Timer           timer;
-            TimePoint       start;
+            PostToLogicShard(shardIndex,
+                             [this, shardIndex, handle, startTime]()
+                             {
+                                 ScheduleSend(shardIndex, handle, startTime);
+                             });
+        }
 
-            EchoTimer(SessionId id,
-                      ThreadPool& workers)
-                : id(id)
-                , timer(workers)
-            {}
+        virtual void HandleReceivedMessage(OwnedMessage receivedMessage) override
+        {
+            GetDispatcher().Dispatch(*this, receivedMessage);
+        }
 
-            ~EchoTimer()
+    private:
+        static const Dispatcher& GetDispatcher()
+        {
+            static constexpr Dispatcher dispatcher = Dispatcher()
+                .Register<Server::MessageId::Echo, &Service::HandleEcho>();
+
+            return dispatcher;
+        }
+
+        static Clock::duration CalculateSendInterval(double rate)
+        {
+            if (rate <= 0.0)
             {
-                std::cout << "[" << id << "] EchoTimer destroyed\n";
+                return Clock::duration::zero();
             }
-        };
 
-    public:
-        Service(size_t nWorkers,
-                size_t nMaxReceivedMessages,
-                uint16_t nConnects)
-            : ClientServiceBase(nWorkers,
-                                nMaxReceivedMessages,
-                                nConnects)
-            , _echoTimersStrand(boost::asio::make_strand(_workers))
-        {}
+            return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate));
+        }
 
-    protected:
-        virtual void OnSessionRegistered(SessionPointer pSession) override
+        static MessageId GetEchoId(EchoTransport transport)
         {
-            boost::asio::post(_echoTimersStrand,
-                              [this, pSession = std::move(pSession)]() mutable
-                              {
-                                  const SessionId id = pSession->GetId();
+            switch (transport)
+            {
+            case EchoTransport::Sequenced:
+                return MessageId::SequencedEcho;
 
-                                  _echoTimers.emplace(id,
-                                                      std::make_unique<EchoTimer>(id,
-                                                                                  _workers));
-                                  
-                                  Echo(std::move(pSession));
-                              });
+            case EchoTransport::Reliable:
+                return MessageId::ReliableEcho;
+
+            default:
+                return MessageId::Echo;
+            }
         }
 
-        virtual void OnSessionUnregistered(SessionPointer pSession) override 
+        // Send schedule of a session on the timing wheel of its logic shard, it ends once the session is gone
+        void ScheduleSend(size_t shardIndex, SessionHandle handle, const TimePoint sendTime)
         {
-            boost::asio::post(_echoTimersStrand,
-                              [this, id = pSession->GetId()]()
-                              {
-                                  _echoTimers.erase(id);
-                              });
+            ScheduleTimer(shardIndex,
+                          sendTime - Clock::now(),
+                          [this, shardIndex, handle, sendTime]()
+                          {
+                              OnSendTimeReached(shardIndex, handle, sendTime);
+                          });
         }
 
-        virtual void HandleReceivedMessage(OwnedMessage receivedMessage) override
+        // Open loop keeps its schedule even when behind, so stalls and the slot of the wheel show up in the latencies
+        // Closed loop stamps the echo when the wheel fires, the wait on the wheel is pacing and not round trip
+        void OnSendTimeReached(size_t shardIndex, SessionHandle handle, TimePoint sendTime)
         {
-            Server::MessageId messageId = 
-                static_cast<Server::MessageId>(receivedMessage.message.header.id);
+            if (FindSession(handle) == nullptr)
+            {
+                return;
+            }
+
+            if (_loadConfig.mode == LoadMode::Closed)
+            {
+                SendEcho(handle, sendTime);
+                return;
+            }
+
+            const TimePoint now = Clock::now();
 
-            switch (messageId)
+            do
             {
-            case Server::MessageId::Echo:
-                HandleEchoAsync(std::move(receivedMessage.pOwner));
+                SendEcho(handle, sendTime);
+                sendTime += _sendInterval;
+            } while (sendTime <= now && _sendInterval > Clock::duration::zero());
+
+            ScheduleSend(shardIndex, handle, sendTime);
+        }
+
+        // Open loop measures from the scheduled send time so that stalls of the sender count, closed loop from the send itself
+        void SendEcho(SessionHandle handle, const TimePoint scheduledTime)
+        {
+            const TimePoint sendTime = (_loadConfig.mode == LoadMode::Open) ? scheduledTime : Clock::now();
+            const size_t payloadSize = _loadConfig.payloadSizes.Generate();
+            const int64_t sendTimeCount = sendTime.time_since_epoch().count();
+
+            Message message;
+            message.header.id = static_cast<NetCommon::Message::Id>(GetEchoId(_loadConfig.transport));
+
+            NetCommon::MessageWriter writer(message, payloadSize);
+            writer << sendTimeCount;
+            writer.WriteZeros(payloadSize - sizeof(sendTimeCount));
+            writer.Finish();
+
+            _nSentMessages.fetch_add(1, std::memory_order_relaxed);
+
+            switch (_loadConfig.transport)
+            {
+            case EchoTransport::Sequenced:
+                SendDatagramAsync(handle, std::move(message), NetCommon::DatagramDelivery::UnreliableSequenced);
+                break;
+
+            case EchoTransport::Reliable:
+                SendDatagramAsync(handle, std::move(message), NetCommon::DatagramDelivery::ReliableOrdered);
                 break;
 
             default:
+                SendMessageAsync(handle, std::move(message));
                 break;
             }
         }
 
-    private:
-        void Echo(SessionPointer pSession)
+        void HandleEcho(SessionHandle handle, Message&& message)
         {
-            const SessionId id = pSession->GetId();
+            const TimePoint receiveTime = Clock::now();
+            int64_t sendTimeCount = 0;
 
-            if (_echoTimers.count(id) == 0)
+            if (!NetCommon::MessageReader(message).Read(sendTimeCount))
             {
-                std::cerr << pSession << " Echo error: non-existent EchoTimer\n";
+                Logger::Error("[", handle, "] Invalid echo");
                 return;
             }
 
-            _echoTimers[id]->start = std::chrono::steady_clock::now();
+            const TimePoint sendTime = TimePoint(Clock::duration(sendTimeCount));
 
-            Message message;
-            message.header.id = static_cast<NetCommon::Message::Id>(MessageId::Echo);
+            if (sendTime >= _measureStartTime)
+            {
+                _latencies.Record(std::chrono::duration_cast<MicroSeconds>(receiveTime - sendTime).count());
+                _nReceivedMessages.fetch_add(1, std::memory_order_relaxed);
+                _nReceivedBytes.fetch_add(message.payload.size(), std::memory_order_relaxed);
+            }
 
-            SendMessageAsync(std::move(pSession), std::move(message));
+            if (_loadConfig.mode == LoadMode::Closed)
+            {
+                ScheduleNextEcho(handle, sendTime);
+            }
         }
 
-        void HandleEchoAsync(SessionPointer pSession)
+        // Closed loop sends again once the reply is in and the interval since the previous send has passed
+        // Echoes are dispatched on the logic shard of their session, so its wheel is the one of this thread
+        void ScheduleNextEcho(SessionHandle handle, const TimePoint lastSendTime)
         {
-            TimePoint end = std::chrono::steady_clock::now();
-            const SessionId id = pSession->GetId();
+            const NetCommon::Session* pSession = FindSession(handle);
 
-            auto elapsed = std::chrono::duration_cast<MicroSeconds>(end - _echoTimers[id]->start);
+            if (pSession == nullptr)
+            {
+                return;
+            }
 
-            boost::asio::post(_echoTimersStrand,
-                              [this, pSession = std::move(pSession)]() mutable
-                              {
-                                  OnEchoCompleted(std::move(pSession));
-                              });
+            ScheduleSend(GetLogicShardIndex(pSession->GetId()), 
+                         handle, 
+                         std::max(Clock::now(), lastSendTime + _sendInterval));
+        }
 
-            std::cout << "[" << id << "] Echo: " << elapsed.count() << "us \n";
+        void WaitReportTimerAsync()
+        {
+            _reportTimer.expires_after(Seconds(1));
+            _reportTimer.async_wait([this](const ErrorCode& error)
+                                    {
+                                        OnReportTimerExpired(error);
+                                    });
         }
 
-        void OnEchoCompleted(SessionPointer pSession)
+        void OnReportTimerExpired(const ErrorCode& error)
         {
-            const SessionId id = pSession->GetId();
+            if (error)
+            {
+                Logger::Error("[REPORT_TIMER] Failed to wait: ", error);
+                return;
+            }
+
+            WaitReportTimerAsync();
 
-            if (_echoTimers.count(id) == 0)
+            if (Clock::now() < _measureStartTime)
             {
-                std::cerr << pSession << " OnEchoCompleted error: non-existent EchoTimer\n";
+                Logger::Info("[CLIENT] Ramping up: ", _nSentMessages.load(std::memory_order_relaxed), " sent");
                 return;
             }
 
-            _echoTimers[id]->timer.expires_after(Seconds(1));
-            _echoTimers[id]->timer.async_wait([this, 
-                                              pSession = std::move(pSession)](const ErrorCode& error) mutable
-                                              {
-                                                  OnEchoTimerExpired(error, std::move(pSession));
-                                              });
+            Histogram intervalLatencies;
+            _latencies.Collect(intervalLatencies);
+
+            std::ostringstream latencies;
+            latencies << intervalLatencies;
+
+            Logger::Info("[CLIENT] Echo: ", intervalLatencies.GetCount(), "/s ", latencies.str(), " (us)");
+
+            _totalLatencies.Merge(intervalLatencies);
         }
 
-        void OnEchoTimerExpired(const ErrorCode& error, SessionPointer pSession)
+        void WaitEndTimerAsync()
         {
-            if (error)
+            if (_loadConfig.duration.count() == 0)
+            {
+                return;
+            }
+
+            _endTimer.expires_at(_measureStartTime + _loadConfig.duration);
+            _endTimer.async_wait([this](const ErrorCode& error)
+                                 {
+                                     if (!error)
+                                     {
+                                         Finish();
+                                     }
+                                 });
+        }
+
+        void WaitSignalAsync()
+        {
+            _signals.async_wait([this](const ErrorCode& error, int signal)
+                                {
+                                    if (error)
+                                    {
+                                        Logger::Error("[SIGNAL] Failed to wait: ", error);
+                                        return;
+                                    }
+
+                                    Logger::Info("[SIGNAL] Stopping on signal ", signal);
+                                    Finish();
+                                });
+        }
+
+        void Finish()
+        {
+            if (_isFinished.exchange(true))
             {
-                std::cerr << pSession << " EchoTimer error: " << error << "\n";
                 return;
             }
 
-            EchoAsync(std::move(pSession));
+            WriteReport();
+            StopWorkers();
         }
 
-        void EchoAsync(SessionPointer pSession)
+        void WriteReport()
         {
-            boost::asio::post(_echoTimersStrand,
-                              [this,
-                              pSession = std::move(pSession)]() mutable
-                              {
-                                  Echo(std::move(pSession));
-                              });
+            _latencies.Collect(_totalLatencies);
+
+            const TimePoint now = Clock::now();
+            const double elapsed = (now > _measureStartTime) ? std::chrono::duration<double>(now - _measureStartTime).count() : 0.0;
+            const uint64_t nReceivedMessages = _nReceivedMessages.load(std::memory_order_relaxed);
+            const uint64_t nReceivedBytes = _nReceivedBytes.load(std::memory_order_relaxed);
+
+            std::ostringstream report;
+            report << _loadConfig
+                   << "Measured: " << elapsed << "s\n"
+                   << "Sent: " << _nSentMessages.load(std::memory_order_relaxed) << "\n"
+                   << "Echoes: " << nReceivedMessages << "\n"
+                   << "Throughput: " << CalculateRate(nReceivedMessages, elapsed) << "/s, " 
+                                     << CalculateRate(nReceivedBytes, elapsed) << "B/s\n"
+                   << "Latency (us, from the " << (_loadConfig.mode == LoadMode::Open ? "scheduled send" : "send") << "): " << _totalLatencies << "\n";
+
+            Logger::Info("[CLIENT] Report\n", report.str());
+
+            std::ofstream summary(_loadConfig.summaryPath);
+
+            if (!summary)
+            {
+                Logger::Error("[CLIENT] Failed to open summary: ", _loadConfig.summaryPath);
+                return;
+            }
+
+            summary << report.str();
+        }
+
+        static uint64_t CalculateRate(uint64_t count, double elapsed)
+        {
+            return (elapsed > 0.0) ? static_cast<uint64_t>(count / elapsed) : 0;
         }
 
     private:
-        EchoTimer::Map      _echoTimers;
-        Strand              _echoTimersStrand;
+        const LoadConfig                        _loadConfig;
+
+        // Senders, _nStartedSenders is touched only on the sessions strand
+        size_t                                  _nStartedSenders;
+        const Clock::duration                   _sendInterval;
+        const TimePoint                         _startTime;
+        const TimePoint                         _measureStartTime;
+
+        // Report, echoes sent before the end of the ramp-up are not counted
+        NetCommon::ShardedLatencyHistogram      _latencies;
+        Histogram                               _totalLatencies;
+        std::atomic<uint64_t>                   _nSentMessages;
+        std::atomic<uint64_t>                   _nReceivedMessages;
+        std::atomic<uint64_t>                   _nReceivedBytes;
+        Timer                                   _reportTimer;
+        Timer                                   _endTimer;
+        SignalSet                               _signals;
+        std::atomic<bool>                       _isFinished;
     
     };
 }
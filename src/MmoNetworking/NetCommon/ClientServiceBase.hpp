@@ -4,98 +4,260 @@
 
 namespace NetCommon
 {
+    // Keeps nConnects connections up, with at most nMaxPendingConnects connects in flight
+    // Failed and dropped connections are retried with exponential backoff
     class ClientServiceBase : public ServiceBase
     {
     protected:
         using Endpoints         = boost::asio::ip::basic_resolver_results<Tcp>;
-        using SocketBuffer      = std::queue<Tcp::socket>;
+        using MilliSeconds      = std::chrono::milliseconds;
+
+        // Connection slot, reused for every reconnect of the connection
+        struct ConnectSlot
+        {
+            using Pointer       = std::unique_ptr<ConnectSlot>;
+            using Vector        = std::vector<Pointer>;
+            using Queue         = std::queue<ConnectSlot*>;
+            using SessionMap    = std::unordered_map<SessionId, ConnectSlot*>;
+
+            const Executor      executor;
+            Tcp::socket         socket;
+            Timer               backoffTimer;
+            size_t              nFailures;
+            bool                hasConnected;
+
+            // The socket stays on the executor, in IoContextPerCore the connection keeps its core across reconnects
+            explicit ConnectSlot(const Executor& executor)
+                : executor(executor)
+                , socket(executor)
+                , backoffTimer(executor)
+                , nFailures(0)
+                , hasConnected(false)
+            {}
+        };
 
     public:
-        ClientServiceBase(size_t nWorkers, 
-                          size_t nMaxReceivedMessages,
+        ClientServiceBase(const ServiceConfig& config,
                           uint16_t nConnects)
-            : ServiceBase(nWorkers, nMaxReceivedMessages)
-            , _connectStrand(boost::asio::make_strand(_workers))
-            , _resolver(_workers)
+            : ServiceBase(config)
+            , _connectStrand(boost::asio::make_strand(_workers.GetExecutor()))
+            , _resolver(_workers.GetExecutor())
+            , _resolveTimer(_workers.GetExecutor())
+            , _nPendingConnects(0)
         {
-            InitConnectBuffer(nConnects);
+            InitConnectSlots(nConnects);
+
+            if (HasFeature(config.sessionFeatures, SessionFeature::Datagram))
+            {
+                OpenDatagramEndpoint(0, false);
+            }
         }
 
         void Start(const char* host, const char* service)
         {   
-            ResolveAsync(host, service);
-            std::cout << "[CLIENT] Started!\n";
+            _host = host;
+            _service = service;
+
+            ResolveAsync();
+            Logger::Info("[CLIENT] Started!");
+        }
+
+    protected:
+        // Services overriding it call it first, it reconnects the session
+        virtual void OnSessionUnregistered(SessionPointer pSession) override
+        {
+            boost::asio::post(_connectStrand,
+                              [this, id = pSession->GetId()]()
+                              {
+                                  OnSessionDropped(id);
+                              });
         }
 
     private:
-        void InitConnectBuffer(const uint16_t nConnects)
+        void InitConnectSlots(const uint16_t nConnects)
         {
             assert(nConnects > 0);
 
             for (int i = 0; i < nConnects; ++i)
             {
-                _connectBuffer.emplace(_workers);
+                _connectSlots.emplace_back(std::make_unique<ConnectSlot>(_workers.GetExecutor()));
             }
         }
 
-        void ResolveAsync(const char* host, const char* service)
+        void ResolveAsync()
         {
-            _resolver.async_resolve(host,
-                                    service,
-                                    [this](const ErrorCode& error,
-                                           Endpoints endpoints)
-                                    {
-                                        OnResolveCompleted(error, std::move(endpoints));
-                                    });
+            _resolver.async_resolve(_host,
+                                    _service,
+                                    boost::asio::bind_executor(_connectStrand,
+                                                               [this](const ErrorCode& error,
+                                                                      Endpoints endpoints)
+                                                               {
+                                                                   OnResolveCompleted(error, std::move(endpoints));
+                                                               }));
         }
 
         void OnResolveCompleted(const ErrorCode& error, Endpoints&& endpoints)
         {
             if (error)
             {
-                std::cerr << "[CLIENT] Failed to resolve: " << error << "\n";
+                Logger::Error("[CLIENT] Failed to resolve: ", error);
+                RetryResolveAsync();
                 return;
             }
 
             _endpoints = std::move(endpoints);
-            ConnectAsync();
+
+            for (ConnectSlot::Pointer& pSlot : _connectSlots)
+            {
+                _waitingSlots.push(pSlot.get());
+            }
+
+            ConnectWaitingSlots();
+        }
+
+        void RetryResolveAsync()
+        {
+            if (_config.reconnectDelay.count() == 0)
+            {
+                return;
+            }
+
+            _resolveTimer.expires_after(_config.maxReconnectDelay);
+            _resolveTimer.async_wait(boost::asio::bind_executor(_connectStrand,
+                                                                [this](const ErrorCode& error)
+                                                                {
+                                                                    if (!error)
+                                                                    {
+                                                                        ResolveAsync();
+                                                                    }
+                                                                }));
+        }
+
+        // Called on _connectStrand, like every handler touching the slots
+        void ConnectWaitingSlots()
+        {
+            while (!_waitingSlots.empty() &&
+                   _nPendingConnects < std::max<size_t>(1, _config.nMaxPendingConnects))
+            {
+                ConnectSlot& slot = *_waitingSlots.front();
+                _waitingSlots.pop();
+
+                ConnectAsync(slot);
+            }
         }
 
-        void ConnectAsync()
+        void ConnectAsync(ConnectSlot& slot)
         {
-            boost::asio::async_connect(_connectBuffer.front(),
+            ++_nPendingConnects;
+            _metrics.nPendingConnects.Add(1);
+
+            boost::asio::async_connect(slot.socket,
                                        _endpoints,
-                                       [this](const ErrorCode& error,
-                                              const Tcp::endpoint& endpoint)
-                                       {
-                                           OnConnectCompleted(error);
-                                       });
+                                       boost::asio::bind_executor(_connectStrand,
+                                                                  [this, &slot](const ErrorCode& error,
+                                                                                const Tcp::endpoint& endpoint)
+                                                                  {
+                                                                      OnConnectCompleted(error, slot);
+                                                                  }));
         }
 
-        void OnConnectCompleted(const ErrorCode& error)
+        void OnConnectCompleted(const ErrorCode& error, ConnectSlot& slot)
         {
+            --_nPendingConnects;
+            _metrics.nPendingConnects.Add(-1);
+
             if (error)
             {
-                std::cerr << "[CLIENT] Failed to connect: " << error << "\n";
+                Logger::Error("[CLIENT] Failed to connect: ", error);
+                _metrics.nConnectFailures.Add(1);
+
+                RetryConnectAsync(slot);
+            }
+            else
+            {
+                _metrics.nConnects.Add(1);
+
+                if (slot.hasConnected)
+                {
+                    _metrics.nReconnects.Add(1);
+                }
+
+                slot.nFailures = 0;
+                slot.hasConnected = true;
+
+                SessionPointer pSession = CreateSession(std::move(slot.socket));
+                slot.socket = Tcp::socket(slot.executor);
+
+                if (pSession == nullptr)
+                {
+                    RetryConnectAsync(slot);
+                }
+                else
+                {
+                    _slotsBySession.emplace(pSession->GetId(), &slot);
+                }
+            }
+
+            ConnectWaitingSlots();
+        }
+
+        void OnSessionDropped(SessionId id)
+        {
+            auto slotIterator = _slotsBySession.find(id);
+
+            if (slotIterator == _slotsBySession.end())
+            {
                 return;
             }
 
-            CreateSession(std::move(_connectBuffer.front()));
-            _connectBuffer.pop();
+            ConnectSlot& slot = *slotIterator->second;
+            _slotsBySession.erase(slotIterator);
 
-            if (_connectBuffer.empty())
+            RetryConnectAsync(slot);
+        }
+
+        // Delay doubles per consecutive failure, jittered so that dropped connections do not reconnect in lockstep
+        void RetryConnectAsync(ConnectSlot& slot)
+        {
+            if (_config.reconnectDelay.count() == 0)
             {
                 return;
             }
 
-            ConnectAsync();
+            const size_t shift = std::min<size_t>(slot.nFailures, 16);
+            const MilliSeconds delay = std::min(_config.reconnectDelay * (int64_t(1) << shift), _config.maxReconnectDelay);
+            ++slot.nFailures;
+
+            thread_local std::mt19937 engine(std::random_device{}());
+            const MilliSeconds jitteredDelay(std::uniform_int_distribution<int64_t>(delay.count() / 2, delay.count())(engine));
+
+            slot.backoffTimer.expires_after(jitteredDelay);
+            slot.backoffTimer.async_wait(boost::asio::bind_executor(_connectStrand,
+                                                                    [this, &slot](const ErrorCode& error)
+                                                                    {
+                                                                        if (error)
+                                                                        {
+                                                                            return;
+                                                                        }
+
+                                                                        _waitingSlots.push(&slot);
+                                                                        ConnectWaitingSlots();
+                                                                    }));
         }
 
     private:
-        SocketBuffer        _connectBuffer;
-        Strand              _connectStrand;
-        Tcp::resolver       _resolver;
-        Endpoints           _endpoints;
+        Strand                      _connectStrand;
+        Tcp::resolver               _resolver;
+        Timer                       _resolveTimer;
+        std::string                 _host;
+        std::string                 _service;
+        Endpoints                   _endpoints;
+
+        // Connector, touched only on _connectStrand
+        ConnectSlot::Vector         _connectSlots;
+        ConnectSlot::Queue          _waitingSlots;
+        ConnectSlot::SessionMap     _slotsBySession;
+        size_t                      _nPendingConnects;
 
     };
 }
@@ -0,0 +1,51 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/Message.hpp>
+
+namespace NetCommon
+{
+    // Ids reserved for messages handled by Session itself
+    enum class ControlMessageId : Message::Id
+    {
+        Begin = 1,
+        // Features the sender supports
+        Hello = Begin,
+        // Features granted, the sender writes with them after this message
+        HelloAck,
+        // Part of a bulk message, the parts of one message are sent back to back
+        Chunk,
+        // Keeps an otherwise quiet session from timing out on the peer
+        Heartbeat,
+        // Token and UDP port of the datagram channel of the session, sent by the server
+        DatagramBind,
+        End,
+    };
+
+    enum class SessionFeature : uint32_t
+    {
+        // Varint id and payload size instead of the fixed header
+        CompactFraming      = 1 << 0,
+        // LZ compressed payloads above the compression threshold
+        Compression         = 1 << 1,
+        // Bulk payloads over the chunk size sent as Chunk messages, so that higher lanes are written in between
+        Chunking            = 1 << 2,
+        // Heartbeat messages on quiet sessions
+        Heartbeat           = 1 << 3,
+        // Datagram channel over UDP next to the session
+        Datagram            = 1 << 4,
+    };
+
+    using SessionFeatures = uint32_t;
+
+    inline bool HasFeature(SessionFeatures features, SessionFeature feature)
+    {
+        return (features & static_cast<SessionFeatures>(feature)) != 0;
+    }
+
+    inline bool IsControlMessage(Message::Id id)
+    {
+        return id >= static_cast<Message::Id>(ControlMessageId::Begin) &&
+               id < static_cast<Message::Id>(ControlMessageId::End);
+    }
+}
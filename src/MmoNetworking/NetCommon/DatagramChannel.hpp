@@ -0,0 +1,400 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/Message.hpp>
+#include <NetCommon/ControlMessage.hpp>
+#include <NetCommon/Varint.hpp>
+
+namespace NetCommon
+{
+    // Unreliable-sequenced drops what arrives after a newer message, for state that the next update replaces
+    // Reliable-ordered is acked and resent, and held back until the messages before it have arrived
+    enum class DatagramDelivery : uint8_t
+    {
+        UnreliableSequenced,
+        ReliableOrdered,
+        Count,
+    };
+
+    // Delivery state of the datagrams of one session, the packets go through a DatagramEndpoint
+    // Packet: token, next reliable sequence the sender expects, then entries up to the end of the datagram
+    // Entry: delivery, sequence, varint id, varint payload size and the payload
+    // Not thread-safe, owned by the strand of the endpoint
+    class DatagramChannel
+    {
+    public:
+        using Token             = uint64_t;
+        using Sequence          = uint16_t;
+        using Packet            = std::vector<std::byte>;
+        using Clock             = std::chrono::steady_clock;
+        using TimePoint         = Clock::time_point;
+
+        static constexpr size_t     HeaderSize          = sizeof(Token) + sizeof(Sequence);
+        static constexpr size_t     MaxEntryHeaderSize  = sizeof(DatagramDelivery) + sizeof(Sequence) + 2 * Varint::MaxSize32;
+        // Reliable messages in flight, the rest wait in the queue until the peer acks
+        static constexpr size_t     ReliableWindow      = 256;
+        // Reliable messages queued at most, a peer this far behind is not reachable over UDP
+        static constexpr size_t     MaxReliableMessages = 16 * 1024;
+
+        static_assert(MaxReliableMessages < std::numeric_limits<Sequence>::max() / 2, "Sequences of the queue must stay comparable");
+
+    private:
+        // Encoded entry, reliable ones are kept until acked
+        struct Entry
+        {
+            Sequence    sequence;
+            Packet      bytes;
+            TimePoint   lastSendTime;
+            bool        isSent;
+        };
+
+        using Entries           = std::deque<Entry>;
+        using HeldMessages      = std::unordered_map<Sequence, Message>;
+
+    public:
+        DatagramChannel(Token token, size_t mtu)
+            : _token(token)
+            , _mtu(std::max(mtu, HeaderSize + MaxEntryHeaderSize + 1))
+            , _nextSequencedSequence(0)
+            , _nextReliableSequence(0)
+            , _lastSequencedSequence(0)
+            , _hasReceivedSequenced(false)
+            , _nextReceiveSequence(0)
+            , _shouldAck(false)
+            , _hasReceived(false)
+        {}
+
+        Token GetToken() const
+        {
+            return _token;
+        }
+
+        // Largest payload that fits a packet on its own, bigger messages go over the session
+        static size_t CalculateMaxPayloadSize(size_t mtu)
+        {
+            return (mtu > HeaderSize + MaxEntryHeaderSize) ? mtu - HeaderSize - MaxEntryHeaderSize : 0;
+        }
+
+        static bool ReadToken(const std::byte* pData, size_t size, Token& token)
+        {
+            if (size < HeaderSize)
+            {
+                return false;
+            }
+
+            std::memcpy(&token, pData, sizeof(token));
+
+            return true;
+        }
+
+        // A packet came from the peer, until then the client keeps sending empty packets so that the server learns its address
+        bool HasReceived() const
+        {
+            return _hasReceived;
+        }
+
+        // False if too many reliable messages are waiting for acks
+        bool Push(const Message& message, DatagramDelivery delivery)
+        {
+            assert(message.payload.size() <= CalculateMaxPayloadSize(_mtu));
+
+            if (delivery == DatagramDelivery::ReliableOrdered)
+            {
+                if (_reliableEntries.size() >= MaxReliableMessages)
+                {
+                    return false;
+                }
+
+                _reliableEntries.push_back(Entry{_nextReliableSequence, EncodeEntry(message, delivery, _nextReliableSequence), TimePoint(), false});
+                ++_nextReliableSequence;
+            }
+            else
+            {
+                _sequencedEntries.push_back(Entry{_nextSequencedSequence, EncodeEntry(message, delivery, _nextSequencedSequence), TimePoint(), false});
+                ++_nextSequencedSequence;
+            }
+
+            return true;
+        }
+
+        // Packs the reliable entries due in the window and the sequenced entries into packets of at most the mtu
+        // An empty packet carries the ack alone, or lets the server learn the address of the client when shouldSendEmpty
+        // Returns the resent reliable entries
+        template<typename TSend>
+        size_t Flush(const TimePoint now, const Clock::duration resendTimeout, bool shouldSendEmpty, TSend&& send)
+        {
+            Packet packet;
+            size_t nResentEntries = 0;
+            bool hasSent = false;
+
+            auto append = [&](const Packet& bytes)
+                          {
+                              if (!packet.empty() && packet.size() + bytes.size() > _mtu)
+                              {
+                                  send(std::move(packet));
+                                  packet.clear();
+                                  hasSent = true;
+                              }
+
+                              if (packet.empty())
+                              {
+                                  StartPacket(packet);
+                              }
+
+                              packet.insert(packet.end(), bytes.begin(), bytes.end());
+                          };
+
+            const size_t nWindowEntries = std::min(_reliableEntries.size(), ReliableWindow);
+
+            for (size_t index = 0; index < nWindowEntries; ++index)
+            {
+                Entry& entry = _reliableEntries[index];
+
+                if (entry.isSent && now < entry.lastSendTime + resendTimeout)
+                {
+                    continue;
+                }
+
+                nResentEntries += entry.isSent ? 1 : 0;
+                entry.isSent = true;
+                entry.lastSendTime = now;
+
+                append(entry.bytes);
+            }
+
+            for (const Entry& entry : _sequencedEntries)
+            {
+                append(entry.bytes);
+            }
+
+            _sequencedEntries.clear();
+
+            if (packet.empty() && !hasSent && (_shouldAck || shouldSendEmpty))
+            {
+                StartPacket(packet);
+            }
+
+            if (!packet.empty())
+            {
+                send(std::move(packet));
+            }
+
+            _shouldAck = false;
+
+            return nResentEntries;
+        }
+
+        // False if the packet is malformed, complete messages go to deliver in order, nDropped counts stale and duplicate ones
+        // deliver returns false to refuse a message and leave it intact, a refused reliable message is not acked and comes again
+        // while a refused sequenced one is dropped
+        template<typename TDeliver>
+        bool Receive(const std::byte* pData, size_t size, TDeliver&& deliver, size_t& nDropped)
+        {
+            Token token = 0;
+            Sequence ack = 0;
+
+            if (!ReadToken(pData, size, token) ||
+                token != _token)
+            {
+                return false;
+            }
+
+            std::memcpy(&ack, pData + sizeof(Token), sizeof(ack));
+
+            // The first packet of the peer is answered, so that the client stops announcing its address
+            if (!_hasReceived)
+            {
+                _hasReceived = true;
+                _shouldAck = true;
+            }
+
+            // Entries before the ack have arrived, the queue is in sequence order
+            while (!_reliableEntries.empty() &&
+                   IsSequenceBefore(_reliableEntries.front().sequence, ack))
+            {
+                _reliableEntries.pop_front();
+            }
+
+            size_t offset = HeaderSize;
+
+            while (offset < size)
+            {
+                DatagramDelivery delivery = DatagramDelivery::Count;
+                Sequence sequence = 0;
+                Message message;
+
+                if (!DecodeEntry(pData, size, offset, delivery, sequence, message))
+                {
+                    return false;
+                }
+
+                if (delivery == DatagramDelivery::UnreliableSequenced)
+                {
+                    if (_hasReceivedSequenced &&
+                        !IsSequenceBefore(_lastSequencedSequence, sequence))
+                    {
+                        ++nDropped;
+                        continue;
+                    }
+
+                    _hasReceivedSequenced = true;
+                    _lastSequencedSequence = sequence;
+
+                    if (!deliver(std::move(message)))
+                    {
+                        ++nDropped;
+                    }
+
+                    continue;
+                }
+
+                _shouldAck = true;
+
+                if (sequence == _nextReceiveSequence)
+                {
+                    if (!deliver(std::move(message)))
+                    {
+                        continue;
+                    }
+
+                    ++_nextReceiveSequence;
+
+                    DeliverHeldMessages(deliver);
+                }
+                else if (IsSequenceBefore(sequence, _nextReceiveSequence) ||
+                         static_cast<Sequence>(sequence - _nextReceiveSequence) >= ReliableWindow ||
+                         !_heldMessages.emplace(sequence, std::move(message)).second)
+                {
+                    ++nDropped;
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        static bool IsSequenceBefore(Sequence sequence, Sequence otherSequence)
+        {
+            return static_cast<int16_t>(static_cast<Sequence>(sequence - otherSequence)) < 0;
+        }
+
+        template<typename TDeliver>
+        void DeliverHeldMessages(TDeliver&& deliver)
+        {
+            auto messageIterator = _heldMessages.find(_nextReceiveSequence);
+
+            while (messageIterator != _heldMessages.end())
+            {
+                if (!deliver(std::move(messageIterator->second)))
+                {
+                    return;
+                }
+
+                _heldMessages.erase(messageIterator);
+                ++_nextReceiveSequence;
+
+                messageIterator = _heldMessages.find(_nextReceiveSequence);
+            }
+        }
+
+        void StartPacket(Packet& packet) const
+        {
+            packet.reserve(_mtu);
+            packet.resize(HeaderSize);
+
+            std::memcpy(packet.data(), &_token, sizeof(_token));
+            std::memcpy(packet.data() + sizeof(_token), &_nextReceiveSequence, sizeof(_nextReceiveSequence));
+        }
+
+        static Packet EncodeEntry(const Message& message, DatagramDelivery delivery, Sequence sequence)
+        {
+            Packet bytes(MaxEntryHeaderSize + message.payload.size());
+            std::byte* pOut = bytes.data();
+
+            *pOut++ = static_cast<std::byte>(delivery);
+            std::memcpy(pOut, &sequence, sizeof(sequence));
+            pOut += sizeof(sequence);
+            pOut += Varint::Encode(message.header.id, pOut);
+            pOut += Varint::Encode(message.payload.size(), pOut);
+
+            if (message.payload.size() > 0)
+            {
+                std::memcpy(pOut, message.payload.data(), message.payload.size());
+                pOut += message.payload.size();
+            }
+
+            bytes.resize(pOut - bytes.data());
+
+            return bytes;
+        }
+
+        static bool DecodeEntry(const std::byte* pData,
+                                size_t size,
+                                size_t& offset,
+                                DatagramDelivery& delivery,
+                                Sequence& sequence,
+                                Message& message)
+        {
+            if (size - offset < sizeof(DatagramDelivery) + sizeof(Sequence))
+            {
+                return false;
+            }
+
+            delivery = static_cast<DatagramDelivery>(pData[offset]);
+            std::memcpy(&sequence, pData + offset + sizeof(DatagramDelivery), sizeof(sequence));
+            offset += sizeof(DatagramDelivery) + sizeof(Sequence);
+
+            uint64_t id = 0;
+            uint64_t payloadSize = 0;
+            size_t decodedSize = 0;
+
+            if (delivery >= DatagramDelivery::Count ||
+                !Varint::Decode(pData + offset, size - offset, id, decodedSize) || decodedSize == 0)
+            {
+                return false;
+            }
+
+            offset += decodedSize;
+
+            if (!Varint::Decode(pData + offset, size - offset, payloadSize, decodedSize) || decodedSize == 0)
+            {
+                return false;
+            }
+
+            offset += decodedSize;
+
+            if (id > std::numeric_limits<Message::Id>::max() ||
+                IsControlMessage(static_cast<Message::Id>(id)) ||
+                payloadSize > size - offset)
+            {
+                return false;
+            }
+
+            message.header.id = static_cast<Message::Id>(id);
+            message.payload.assign(pData + offset, pData + offset + payloadSize);
+            message.header.size = static_cast<Message::Size>(message.CalculateSize());
+            offset += payloadSize;
+
+            return true;
+        }
+
+    private:
+        const Token         _token;
+        const size_t        _mtu;
+
+        // Send, sequenced entries are sent once with the next flush
+        Entries             _sequencedEntries;
+        Entries             _reliableEntries;
+        Sequence            _nextSequencedSequence;
+        Sequence            _nextReliableSequence;
+
+        // Receive, reliable messages ahead of the next sequence are held until the gap is filled
+        Sequence            _lastSequencedSequence;
+        bool                _hasReceivedSequenced;
+        Sequence            _nextReceiveSequence;
+        HeldMessages        _heldMessages;
+        bool                _shouldAck;
+        bool                _hasReceived;
+
+    };
+}
@@ -0,0 +1,356 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/DatagramChannel.hpp>
+#include <NetCommon/Session.hpp>
+#include <NetCommon/Metrics.hpp>
+#include <NetCommon/Logger.hpp>
+
+namespace NetCommon
+{
+    // UDP socket shared by the datagram channels of the sessions, each channel is found by the token of its packets
+    // The server issues the tokens and learns the address of a client from its packets, the client sends to the bound address
+    // Every channel is touched only on the strand, sends of a burst are packed together by a flush posted behind them
+    class DatagramEndpoint
+    {
+    public:
+        using Pointer       = std::unique_ptr<DatagramEndpoint>;
+
+    private:
+        using Executor      = boost::asio::any_io_executor;
+        using Strand        = boost::asio::strand<Executor>;
+        using Timer         = boost::asio::steady_timer;
+        using ErrorCode     = boost::system::error_code;
+        using Udp           = boost::asio::ip::udp;
+        using Clock         = std::chrono::steady_clock;
+        using TimePoint     = Clock::time_point;
+        using Token         = DatagramChannel::Token;
+        using Packet        = DatagramChannel::Packet;
+
+        struct Binding
+        {
+            using Map       = std::unordered_map<Token, Binding>;
+
+            DatagramChannel         channel;
+            std::weak_ptr<Session>  pSession;
+            Udp::endpoint           remoteEndpoint;
+            bool                    isFlushPending;
+
+            Binding(Token token, size_t mtu, std::weak_ptr<Session> pSession, Udp::endpoint remoteEndpoint)
+                : channel(token, mtu)
+                , pSession(std::move(pSession))
+                , remoteEndpoint(std::move(remoteEndpoint))
+                , isFlushPending(false)
+            {}
+        };
+
+        static constexpr size_t     ReceiveBufferSize   = 64 * 1024;
+
+        using ReceiveBuffer         = std::array<std::byte, ReceiveBufferSize>;
+
+    public:
+        // Port 0 binds an ephemeral port
+        DatagramEndpoint(const Executor& executor,
+                         uint16_t port,
+                         size_t mtu,
+                         Clock::duration flushInterval,
+                         Clock::duration resendTimeout,
+                         ServiceMetrics& metrics)
+            : _strand(boost::asio::make_strand(executor))
+            , _socket(_strand, Udp::endpoint(Udp::v4(), port))
+            , _flushTimer(_strand)
+            , _mtu(mtu)
+            , _flushInterval(flushInterval)
+            , _resendTimeout(resendTimeout)
+            , _isFlushPosted(false)
+            , _pReceiveBuffer(std::make_unique<ReceiveBuffer>())
+            , _metrics(metrics)
+        {
+            ReceiveAsync();
+            WaitFlushTimerAsync();
+        }
+
+        uint16_t GetPort() const
+        {
+            return _socket.local_endpoint().port();
+        }
+
+        size_t GetMaxPayloadSize() const
+        {
+            return DatagramChannel::CalculateMaxPayloadSize(_mtu);
+        }
+
+        // Server: the channel waits for the first packet of the client to learn its address
+        Token OpenChannelAsync(const Session::Pointer& pSession)
+        {
+            thread_local std::mt19937_64 engine(std::random_device{}());
+            Token token = 0;
+
+            while (token == 0)
+            {
+                token = engine();
+            }
+
+            OpenChannelAsync(pSession, token, Udp::endpoint());
+
+            return token;
+        }
+
+        // Client: the token and port come from the DatagramBind of the server
+        void OpenChannelAsync(const Session::Pointer& pSession, Token token, Udp::endpoint remoteEndpoint)
+        {
+            boost::asio::post(_strand,
+                              [this, pSession = std::weak_ptr<Session>(pSession), token, remoteEndpoint]() mutable
+                              {
+                                  _bindings.emplace(std::piecewise_construct,
+                                                    std::forward_as_tuple(token),
+                                                    std::forward_as_tuple(token, _mtu, std::move(pSession), std::move(remoteEndpoint)));
+                              });
+        }
+
+        // Goes over the session while the channel has no address yet
+        void SendAsync(Session::Pointer pSession, Message&& message, DatagramDelivery delivery)
+        {
+            boost::asio::post(_strand,
+                              [this, pSession = std::move(pSession), message = std::move(message), delivery]() mutable
+                              {
+                                  Send(std::move(pSession), std::move(message), delivery);
+                              });
+        }
+
+    private:
+        void Send(Session::Pointer pSession, Message&& message, DatagramDelivery delivery)
+        {
+            auto bindingIterator = _bindings.find(pSession->GetDatagramToken());
+
+            if (bindingIterator == _bindings.end() ||
+                bindingIterator->second.remoteEndpoint.port() == 0)
+            {
+                pSession->SendMessageAsync(std::move(message), SendOptions{SendLane::Realtime});
+                return;
+            }
+
+            Binding& binding = bindingIterator->second;
+
+            if (!binding.channel.Push(message, delivery))
+            {
+                Logger::Error("[", pSession->GetId(), "] Datagram channel closed: too many unacked messages");
+
+                _bindings.erase(bindingIterator);
+                pSession->CloseAsync();
+                return;
+            }
+
+            if (binding.isFlushPending)
+            {
+                return;
+            }
+
+            binding.isFlushPending = true;
+            _pendingTokens.push_back(binding.channel.GetToken());
+
+            if (!_isFlushPosted)
+            {
+                _isFlushPosted = true;
+
+                boost::asio::post(_strand,
+                                  [this]()
+                                  {
+                                      FlushPendingChannels();
+                                  });
+            }
+        }
+
+        void FlushPendingChannels()
+        {
+            const TimePoint now = Clock::now();
+
+            for (const Token token : _pendingTokens)
+            {
+                auto bindingIterator = _bindings.find(token);
+
+                if (bindingIterator != _bindings.end())
+                {
+                    bindingIterator->second.isFlushPending = false;
+                    Flush(bindingIterator->second, now);
+                }
+            }
+
+            _pendingTokens.clear();
+            _isFlushPosted = false;
+        }
+
+        void Flush(Binding& binding, const TimePoint now)
+        {
+            if (binding.remoteEndpoint.port() == 0)
+            {
+                return;
+            }
+
+            const size_t nResentEntries = binding.channel.Flush(now,
+                                                                _resendTimeout,
+                                                                !binding.channel.HasReceived(),
+                                                                [this, &binding](Packet&& packet)
+                                                                {
+                                                                    SendPacketAsync(binding.remoteEndpoint, std::move(packet));
+                                                                });
+
+            _metrics.nDatagramResends.Add(nResentEntries);
+        }
+
+        void SendPacketAsync(const Udp::endpoint& remoteEndpoint, Packet&& packet)
+        {
+            auto pPacket = std::make_shared<Packet>(std::move(packet));
+
+            _metrics.nDatagramsSent.Add(1);
+            _metrics.nDatagramBytesSent.Add(pPacket->size());
+
+            _socket.async_send_to(boost::asio::buffer(*pPacket),
+                                  remoteEndpoint,
+                                  [this, pPacket](const ErrorCode& error,
+                                                  const size_t)
+                                  {
+                                      if (error && 
+                                          error != boost::asio::error::operation_aborted)
+                                      {
+                                          _metrics.nFailedDatagramSends.Add(1);
+                                      }
+                                  });
+        }
+
+        void ReceiveAsync()
+        {
+            _socket.async_receive_from(boost::asio::buffer(*_pReceiveBuffer),
+                                       _senderEndpoint,
+                                       [this](const ErrorCode& error,
+                                              const size_t nBytesTransferred)
+                                       {
+                                           OnReceiveCompleted(error, nBytesTransferred);
+                                       });
+        }
+
+        // Errors such as ICMP port unreachable of a gone peer only drop that datagram
+        void OnReceiveCompleted(const ErrorCode& error, const size_t nBytesTransferred)
+        {
+            if (error == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+
+            if (!error)
+            {
+                _metrics.nDatagramsReceived.Add(1);
+                _metrics.nDatagramBytesReceived.Add(nBytesTransferred);
+
+                HandlePacket(_pReceiveBuffer->data(), nBytesTransferred);
+            }
+
+            ReceiveAsync();
+        }
+
+        void HandlePacket(const std::byte* pData, size_t size)
+        {
+            Token token = 0;
+
+            if (!DatagramChannel::ReadToken(pData, size, token))
+            {
+                _metrics.nDroppedDatagrams.Add(1);
+                return;
+            }
+
+            auto bindingIterator = _bindings.find(token);
+
+            if (bindingIterator == _bindings.end())
+            {
+                _metrics.nDroppedDatagrams.Add(1);
+                return;
+            }
+
+            Binding& binding = bindingIterator->second;
+            Session::Pointer pSession = binding.pSession.lock();
+
+            if (pSession == nullptr)
+            {
+                _bindings.erase(bindingIterator);
+                _metrics.nDroppedDatagrams.Add(1);
+                return;
+            }
+
+            size_t nDroppedMessages = 0;
+
+            if (!binding.channel.Receive(pData,
+                                         size,
+                                         [&pSession](Message&& message)
+                                         {
+                                             return pSession->PushDatagramMessage(std::move(message));
+                                         },
+                                         nDroppedMessages))
+            {
+                _metrics.nDroppedDatagrams.Add(1);
+                return;
+            }
+
+            _metrics.nDroppedDatagramMessages.Add(nDroppedMessages);
+
+            // The token authenticates the packet, the client may come from a new address after a NAT rebinding
+            if (binding.remoteEndpoint != _senderEndpoint)
+            {
+                binding.remoteEndpoint = _senderEndpoint;
+            }
+        }
+
+        // Resends, acks and address announcements, channels of gone sessions are closed here
+        void WaitFlushTimerAsync()
+        {
+            _flushTimer.expires_after(_flushInterval);
+            _flushTimer.async_wait([this](const ErrorCode& error)
+                                   {
+                                       if (error)
+                                       {
+                                           return;
+                                       }
+
+                                       FlushAllChannels();
+                                       WaitFlushTimerAsync();
+                                   });
+        }
+
+        void FlushAllChannels()
+        {
+            const TimePoint now = Clock::now();
+
+            for (auto bindingIterator = _bindings.begin(); bindingIterator != _bindings.end();)
+            {
+                if (bindingIterator->second.pSession.expired())
+                {
+                    bindingIterator = _bindings.erase(bindingIterator);
+                    continue;
+                }
+
+                Flush(bindingIterator->second, now);
+                ++bindingIterator;
+            }
+        }
+
+    private:
+        Strand                          _strand;
+        Udp::socket                     _socket;
+        Timer                           _flushTimer;
+        const size_t                    _mtu;
+        const Clock::duration           _flushInterval;
+        const Clock::duration           _resendTimeout;
+
+        // Channels, touched only on _strand
+        Binding::Map                    _bindings;
+        std::vector<Token>              _pendingTokens;
+        bool                            _isFlushPosted;
+
+        // Receive
+        std::unique_ptr<ReceiveBuffer>  _pReceiveBuffer;
+        Udp::endpoint                   _senderEndpoint;
+
+        // Owned by the service
+        ServiceMetrics&                 _metrics;
+
+    };
+}
@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/Message.hpp>
+#include <NetCommon/MemoryPool.hpp>
+#include <NetCommon/FrameCodec.hpp>
+
+namespace NetCommon
+{
+    // Send queue lanes of a session, a lane is written only while the lanes above it are empty
+    enum class SendLane : uint8_t
+    {
+        Realtime,
+        Normal,
+        Bulk,
+        Count,
+    };
+
+    struct SendOptions
+    {
+        SendLane    lane            = SendLane::Normal;
+        // May be dropped by the slow consumer policy of a session before it is written
+        bool        isDroppable     = false;
+    };
+
+    // Immutable encoded message shared by the send buffers of every recipient
+    class Frame
+    {
+    public:
+        using Pointer       = std::shared_ptr<const Frame>;
+        using Buffer        = std::queue<Pointer>;
+
+    public:
+        template<typename TMessage>
+        static Pointer Create(TMessage&& message, SendOptions options = SendOptions())
+        {
+            return std::allocate_shared<const Frame>(PoolAllocator<Frame>(),
+                                                     std::forward<TMessage>(message),
+                                                     options);
+        }
+
+        explicit Frame(const Message& message, SendOptions options = SendOptions())
+            : _message(message)
+            , _options(options)
+        {}
+
+        explicit Frame(Message&& message, SendOptions options = SendOptions())
+            : _message(std::move(message))
+            , _options(options)
+        {}
+
+        const Message::Header& GetHeader() const
+        {
+            return _message.header;
+        }
+
+        const Message::Payload& GetPayload() const
+        {
+            return _message.payload;
+        }
+
+        size_t GetSize() const
+        {
+            return _message.CalculateSize();
+        }
+
+        SendLane GetLane() const
+        {
+            return _options.lane;
+        }
+
+        bool IsDroppable() const
+        {
+            return _options.isDroppable;
+        }
+
+        // Compressed once on first use and shared by every session, empty if it does not shrink
+        const Message::Payload& GetCompressedPayload() const
+        {
+            std::call_once(_compressOnce,
+                           [this]()
+                           {
+                               FrameCodec::CompressPayload(_message.payload, _compressedPayload);
+                           });
+
+            return _compressedPayload;
+        }
+
+    private:
+        const Message               _message;
+        const SendOptions           _options;
+        mutable std::once_flag      _compressOnce;
+        mutable Message::Payload    _compressedPayload;
+
+    };
+}
@@ -0,0 +1,161 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/Message.hpp>
+#include <NetCommon/ControlMessage.hpp>
+#include <NetCommon/Varint.hpp>
+#include <NetCommon/LzCodec.hpp>
+
+namespace NetCommon
+{
+    // Wire encoding of message headers and compressed payloads
+    // Fixed: Message::Header with the compressed flag in the top bit of the id
+    // Compact: varint of id << 1 | compressed flag and varint payload size
+    // Compressed payload: varint original size and an LzCodec block
+    struct FrameCodec
+    {
+        enum class Result
+        {
+            Complete,
+            Incomplete,
+            Invalid,
+        };
+
+        static constexpr size_t     MaxHeaderSize   = 2 * Varint::MaxSize32;
+        static constexpr Message::Id    CompressedIdFlag    = Message::Id(1) << 31;
+
+        static_assert(sizeof(Message::Header) <= MaxHeaderSize, "MaxHeaderSize must fit the fixed header");
+
+        static size_t EncodeHeader(SessionFeatures features, 
+                                   const Message::Header& header, 
+                                   bool isCompressed, 
+                                   std::byte* pOut)
+        {
+            assert((header.id & CompressedIdFlag) == 0);
+
+            if (!HasFeature(features, SessionFeature::CompactFraming))
+            {
+                Message::Header wireHeader = header;
+                wireHeader.id |= isCompressed ? CompressedIdFlag : 0;
+
+                std::memcpy(pOut, &wireHeader, sizeof(Message::Header));
+
+                return sizeof(Message::Header);
+            }
+
+            size_t size = Varint::Encode((static_cast<uint64_t>(header.id) << 1) | (isCompressed ? 1 : 0), pOut);
+            size += Varint::Encode(header.size - sizeof(Message::Header), pOut + size);
+
+            return size;
+        }
+
+        // Decoded header.size is the in-memory size, sizeof(Message::Header) + payload size
+        static Result DecodeHeader(SessionFeatures features, 
+                                   const std::byte* pData, 
+                                   size_t size, 
+                                   Message::Header& header, 
+                                   bool& isCompressed,
+                                   size_t& headerSize)
+        {
+            if (!HasFeature(features, SessionFeature::CompactFraming))
+            {
+                if (size < sizeof(Message::Header))
+                {
+                    return Result::Incomplete;
+                }
+
+                std::memcpy(&header, pData, sizeof(Message::Header));
+                headerSize = sizeof(Message::Header);
+
+                isCompressed = (header.id & CompressedIdFlag) != 0;
+                header.id &= ~CompressedIdFlag;
+
+                return (header.size < sizeof(Message::Header)) ? Result::Invalid : Result::Complete;
+            }
+
+            uint64_t id = 0;
+            uint64_t payloadSize = 0;
+            size_t idSize = 0;
+            size_t payloadSizeSize = 0;
+
+            if (!Varint::Decode(pData, size, id, idSize))
+            {
+                return Result::Invalid;
+            }
+
+            if (idSize == 0)
+            {
+                return Result::Incomplete;
+            }
+
+            if (!Varint::Decode(pData + idSize, size - idSize, payloadSize, payloadSizeSize))
+            {
+                return Result::Invalid;
+            }
+
+            if (payloadSizeSize == 0)
+            {
+                return Result::Incomplete;
+            }
+
+            isCompressed = (id & 1) != 0;
+            id >>= 1;
+
+            if (id > std::numeric_limits<Message::Id>::max() ||
+                payloadSize > std::numeric_limits<Message::Size>::max() - sizeof(Message::Header))
+            {
+                return Result::Invalid;
+            }
+
+            header.id = static_cast<Message::Id>(id);
+            header.size = static_cast<Message::Size>(sizeof(Message::Header) + payloadSize);
+            headerSize = idSize + payloadSizeSize;
+
+            return Result::Complete;
+        }
+    
+        // False if compression does not shrink the payload
+        static bool CompressPayload(const Message::Payload& payload, Message::Payload& compressed)
+        {
+            const size_t capacity = Varint::MaxSize64 + LzCodec::CalculateMaxCompressedSize(payload.size());
+            compressed.resize(capacity);
+
+            const size_t prefixSize = Varint::Encode(payload.size(), compressed.data());
+            const size_t blockSize = LzCodec::Compress(payload.data(), 
+                                                       payload.size(), 
+                                                       compressed.data() + prefixSize, 
+                                                       capacity - prefixSize);
+
+            if (blockSize == 0 ||
+                prefixSize + blockSize >= payload.size())
+            {
+                compressed.clear();
+                return false;
+            }
+
+            compressed.resize(prefixSize + blockSize);
+
+            return true;
+        }
+
+        static bool DecompressPayload(const std::byte* pData, 
+                                      size_t size, 
+                                      size_t maxSize, 
+                                      Message::Payload& payload)
+        {
+            uint64_t originalSize = 0;
+            size_t prefixSize = 0;
+
+            if (!Varint::Decode(pData, size, originalSize, prefixSize) ||
+                prefixSize == 0 ||
+                originalSize > maxSize)
+            {
+                return false;
+            }
+
+            payload.resize(static_cast<size_t>(originalSize));
+
+            return LzCodec::Decompress(pData + prefixSize, size - prefixSize, payload.data(), payload.size());
+        }
+    };
+}
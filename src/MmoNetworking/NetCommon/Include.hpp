@@ -1,15 +1,32 @@
 ﻿#pragma once
 
 #include <cassert>
+#include <stdexcept>
 #include <memory>
+#include <new>
+#include <atomic>
+#include <type_traits>
+#include <functional>
+#include <array>
+#include <algorithm>
 #include <utility>
+#include <tuple>
 #include <queue>
 #include <vector>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <chrono>
+#include <random>
+#include <thread>
+#include <mutex>
 #include <cstdint>
+#include <limits>
 #include <cstddef>
+#include <cstring>
 
 #ifdef _WIN32
 #define WINVER          0x0A00
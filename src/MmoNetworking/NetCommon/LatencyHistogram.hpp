@@ -0,0 +1,234 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/ThreadIndex.hpp>
+
+namespace NetCommon
+{
+    // Log-bucketed histogram in the HDR style, 32 linear sub-buckets per power of two (~3% precision)
+    // Record is lock-free, Merge and Reset may run concurrently with it
+    class LatencyHistogram
+    {
+    public:
+        using Value         = uint64_t;
+
+    private:
+        static constexpr size_t     SubBucketBits   = 5;
+        static constexpr size_t     SubBucketCount  = size_t(1) << SubBucketBits;
+        static constexpr size_t     MaxValueBits    = 40;
+        static constexpr size_t     BucketCount     = (MaxValueBits - SubBucketBits + 1) * SubBucketCount;
+
+    public:
+        static constexpr Value      MaxValue        = (Value(1) << MaxValueBits) - 1;
+
+        LatencyHistogram()
+            : _count(0)
+            , _max(0)
+        {
+            for (std::atomic<uint64_t>& bucket : _buckets)
+            {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void Record(Value value)
+        {
+            value = std::min(value, MaxValue);
+
+            _buckets[CalculateIndex(value)].fetch_add(1, std::memory_order_relaxed);
+            _count.fetch_add(1, std::memory_order_relaxed);
+
+            Value max = _max.load(std::memory_order_relaxed);
+
+            while (value > max &&
+                   !_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+            {}
+        }
+
+        void Merge(const LatencyHistogram& other)
+        {
+            for (size_t index = 0; index < BucketCount; ++index)
+            {
+                const uint64_t count = other._buckets[index].load(std::memory_order_relaxed);
+
+                if (count > 0)
+                {
+                    _buckets[index].fetch_add(count, std::memory_order_relaxed);
+                }
+            }
+
+            _count.fetch_add(other._count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+            const Value otherMax = other._max.load(std::memory_order_relaxed);
+            Value max = _max.load(std::memory_order_relaxed);
+
+            while (otherMax > max &&
+                   !_max.compare_exchange_weak(max, otherMax, std::memory_order_relaxed))
+            {}
+        }
+
+        // Move every count into the other histogram and reset this one
+        void MoveTo(LatencyHistogram& other)
+        {
+            for (size_t index = 0; index < BucketCount; ++index)
+            {
+                const uint64_t count = _buckets[index].exchange(0, std::memory_order_relaxed);
+
+                if (count > 0)
+                {
+                    other._buckets[index].fetch_add(count, std::memory_order_relaxed);
+                    other._count.fetch_add(count, std::memory_order_relaxed);
+                }
+            }
+
+            const Value max = _max.exchange(0, std::memory_order_relaxed);
+            Value otherMax = other._max.load(std::memory_order_relaxed);
+
+            while (max > otherMax &&
+                   !other._max.compare_exchange_weak(otherMax, max, std::memory_order_relaxed))
+            {}
+
+            _count.store(0, std::memory_order_relaxed);
+        }
+
+        void Reset()
+        {
+            for (std::atomic<uint64_t>& bucket : _buckets)
+            {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+
+            _count.store(0, std::memory_order_relaxed);
+            _max.store(0, std::memory_order_relaxed);
+        }
+
+        uint64_t GetCount() const
+        {
+            return _count.load(std::memory_order_relaxed);
+        }
+
+        Value GetMax() const
+        {
+            return _max.load(std::memory_order_relaxed);
+        }
+
+        // Highest value equivalent to the bucket holding the percentile, 0 to 100
+        Value CalculatePercentile(double percentile) const
+        {
+            const uint64_t totalCount = GetCount();
+
+            if (totalCount == 0)
+            {
+                return 0;
+            }
+
+            const double clamped = std::min(std::max(percentile, 0.0), 100.0);
+            const uint64_t targetCount = std::max<uint64_t>(1, static_cast<uint64_t>(clamped / 100.0 * totalCount + 0.5));
+            uint64_t count = 0;
+
+            for (size_t index = 0; index < BucketCount; ++index)
+            {
+                count += _buckets[index].load(std::memory_order_relaxed);
+
+                if (count >= targetCount)
+                {
+                    return std::min(CalculateHighestValue(index), GetMax());
+                }
+            }
+
+            return GetMax();
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const LatencyHistogram& histogram)
+        {
+            os << "p50: " << histogram.CalculatePercentile(50.0)
+               << " p90: " << histogram.CalculatePercentile(90.0)
+               << " p99: " << histogram.CalculatePercentile(99.0)
+               << " p99.9: " << histogram.CalculatePercentile(99.9)
+               << " max: " << histogram.GetMax();
+
+            return os;
+        }
+
+    private:
+        static size_t CalculateIndex(Value value)
+        {
+            if (value < 2 * SubBucketCount)
+            {
+                return static_cast<size_t>(value);
+            }
+
+            const size_t shift = CalculateMostSignificantBit(value) - SubBucketBits;
+
+            return shift * SubBucketCount + static_cast<size_t>(value >> shift);
+        }
+
+        static Value CalculateHighestValue(size_t index)
+        {
+            if (index < 2 * SubBucketCount)
+            {
+                return index;
+            }
+
+            const size_t shift = index / SubBucketCount - 1;
+            const Value subBucket = index % SubBucketCount + SubBucketCount;
+
+            return ((subBucket + 1) << shift) - 1;
+        }
+
+        static size_t CalculateMostSignificantBit(Value value)
+        {
+            size_t bit = 0;
+
+            while (value >>= 1)
+            {
+                ++bit;
+            }
+
+            return bit;
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, BucketCount>  _buckets;
+        std::atomic<uint64_t>                           _count;
+        std::atomic<Value>                              _max;
+
+    };
+
+    // Histogram per recording thread, collected into one without contending with the recorders
+    class ShardedLatencyHistogram
+    {
+    private:
+        struct alignas(64) Shard
+        {
+            LatencyHistogram    histogram;
+        };
+
+    public:
+        using Value         = LatencyHistogram::Value;
+
+        explicit ShardedLatencyHistogram(size_t nShards)
+            : _shards(nShards)
+        {
+            assert(nShards > 0);
+        }
+
+        void Record(Value value)
+        {
+            _shards[ThreadIndex::Get() % _shards.size()].histogram.Record(value);
+        }
+
+        // Move what was recorded since the last collect into the histogram
+        void Collect(LatencyHistogram& histogram)
+        {
+            for (Shard& shard : _shards)
+            {
+                shard.histogram.MoveTo(histogram);
+            }
+        }
+
+    private:
+        std::vector<Shard>      _shards;
+
+    };
+}
@@ -0,0 +1,308 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+
+// Records below this level are compiled out, 0 Debug, 1 Info, 2 Warning, 3 Error
+#ifndef NETCOMMON_LOG_LEVEL
+#define NETCOMMON_LOG_LEVEL 1
+#endif
+
+namespace NetCommon
+{
+    enum class LogLevel : uint8_t
+    {
+        Debug,
+        Info,
+        Warning,
+        Error,
+        None
+    };
+
+    // Asynchronous logger, producers move their arguments into a per-thread ring and return
+    // A background thread formats the records with operator<< and writes them, Info and below to cout, the rest to cerr
+    // Records are dropped instead of blocking when the ring of the thread is full
+    // Arguments are formatted later, so pass values and not pointers to mutable or short-lived data
+    class Logger
+    {
+    private:
+        using Clock             = std::chrono::steady_clock;
+        using FormatFunction    = void(*)(std::ostream&, std::byte*);
+
+        static constexpr LogLevel   CompiledLevel   = static_cast<LogLevel>(NETCOMMON_LOG_LEVEL);
+        static constexpr size_t     MaxArgsSize     = 192;
+        static constexpr size_t     RingCapacity    = 1024;
+
+        struct Record
+        {
+            Clock::rep                          time;
+            LogLevel                            level;
+            FormatFunction                      format;
+            alignas(std::max_align_t) std::byte args[MaxArgsSize];
+        };
+
+        // Single producer single consumer ring, the producer is the owning thread
+        class Ring
+        {
+        public:
+            Ring()
+                : _head(0)
+                , _tail(0)
+            {}
+
+            Record* TryAcquire()
+            {
+                const size_t head = _head.load(std::memory_order_relaxed);
+
+                if (head - _tail.load(std::memory_order_acquire) == RingCapacity)
+                {
+                    return nullptr;
+                }
+
+                return &_records[head % RingCapacity];
+            }
+
+            void Publish()
+            {
+                _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            Record* TryPeek()
+            {
+                const size_t tail = _tail.load(std::memory_order_relaxed);
+
+                if (tail == _head.load(std::memory_order_acquire))
+                {
+                    return nullptr;
+                }
+
+                return &_records[tail % RingCapacity];
+            }
+
+            void Release()
+            {
+                _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+        private:
+            std::array<Record, RingCapacity>    _records;
+            alignas(64) std::atomic<size_t>     _head;
+            alignas(64) std::atomic<size_t>     _tail;
+
+        };
+
+        struct Line
+        {
+            Clock::rep      time;
+            LogLevel        level;
+            std::string     text;
+        };
+
+    public:
+        template<typename... TArgs>
+        static void Debug(TArgs&&... args)
+        {
+            Log<LogLevel::Debug>(std::forward<TArgs>(args)...);
+        }
+
+        template<typename... TArgs>
+        static void Info(TArgs&&... args)
+        {
+            Log<LogLevel::Info>(std::forward<TArgs>(args)...);
+        }
+
+        template<typename... TArgs>
+        static void Warning(TArgs&&... args)
+        {
+            Log<LogLevel::Warning>(std::forward<TArgs>(args)...);
+        }
+
+        template<typename... TArgs>
+        static void Error(TArgs&&... args)
+        {
+            Log<LogLevel::Error>(std::forward<TArgs>(args)...);
+        }
+
+        template<LogLevel Level, typename... TArgs>
+        static void Log(TArgs&&... args)
+        {
+            if constexpr (Level >= CompiledLevel)
+            {
+                Logger& logger = Get();
+
+                if (Level < logger._level.load(std::memory_order_relaxed))
+                {
+                    return;
+                }
+
+                logger.Push(Level, std::forward<TArgs>(args)...);
+            }
+        }
+
+        // Runtime filter on top of NETCOMMON_LOG_LEVEL
+        static void SetLevel(LogLevel level)
+        {
+            Get()._level.store(level, std::memory_order_relaxed);
+        }
+
+        ~Logger()
+        {
+            _isRunning.store(false);
+            _writer.join();
+        }
+
+    private:
+        Logger()
+            : _level(CompiledLevel)
+            , _nDroppedRecords(0)
+            , _isRunning(true)
+            , _writer([this]()
+                      {
+                          Run();
+                      })
+        {}
+
+        static Logger& Get()
+        {
+            static Logger logger;
+
+            return logger;
+        }
+
+        template<typename... TArgs>
+        void Push(LogLevel level, TArgs&&... args)
+        {
+            using Args = std::tuple<std::decay_t<TArgs>...>;
+
+            static_assert(sizeof(Args) <= MaxArgsSize, "Too many log arguments");
+            static_assert(alignof(Args) <= alignof(std::max_align_t), "Over-aligned log argument");
+
+            Ring& ring = GetThreadRing();
+            Record* pRecord = ring.TryAcquire();
+
+            if (pRecord == nullptr)
+            {
+                _nDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            pRecord->time = Clock::now().time_since_epoch().count();
+            pRecord->level = level;
+            pRecord->format = &FormatArgs<Args>;
+            new (pRecord->args) Args(std::forward<TArgs>(args)...);
+
+            ring.Publish();
+        }
+
+        template<typename TArgs>
+        static void FormatArgs(std::ostream& os, std::byte* pArgs)
+        {
+            TArgs& args = *std::launder(reinterpret_cast<TArgs*>(pArgs));
+
+            std::apply([&os](const auto&... arg)
+                       {
+                           (os << ... << arg);
+                       },
+                       args);
+
+            args.~TArgs();
+        }
+
+        Ring& GetThreadRing()
+        {
+            thread_local Ring* pRing = nullptr;
+
+            if (pRing == nullptr)
+            {
+                std::lock_guard<std::mutex> lock(_ringsMutex);
+
+                _rings.emplace_back(std::make_unique<Ring>());
+                pRing = _rings.back().get();
+            }
+
+            return *pRing;
+        }
+
+        void Run()
+        {
+            bool isRunning = true;
+
+            while (isRunning)
+            {
+                isRunning = _isRunning.load();
+
+                if (!Drain() && isRunning)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+        }
+
+        // Format every published record, ordered by time across the rings
+        bool Drain()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_ringsMutex);
+
+                for (std::unique_ptr<Ring>& pRing : _rings)
+                {
+                    while (Record* pRecord = pRing->TryPeek())
+                    {
+                        std::ostringstream os;
+                        pRecord->format(os, pRecord->args);
+                        os << "\n";
+
+                        _lines.push_back(Line{pRecord->time, pRecord->level, os.str()});
+                        pRing->Release();
+                    }
+                }
+            }
+
+            const uint64_t nDroppedRecords = _nDroppedRecords.exchange(0, std::memory_order_relaxed);
+
+            if (nDroppedRecords > 0)
+            {
+                std::ostringstream os;
+                os << "[LOGGER] Dropped records: " << nDroppedRecords << "\n";
+
+                _lines.push_back(Line{Clock::now().time_since_epoch().count(), LogLevel::Warning, os.str()});
+            }
+
+            if (_lines.empty())
+            {
+                return false;
+            }
+
+            std::stable_sort(_lines.begin(), 
+                             _lines.end(), 
+                             [](const Line& lhs, const Line& rhs)
+                             {
+                                 return lhs.time < rhs.time;
+                             });
+
+            for (const Line& line : _lines)
+            {
+                std::ostream& os = (line.level >= LogLevel::Warning) ? std::cerr : std::cout;
+                os << line.text;
+            }
+
+            std::cout.flush();
+            _lines.clear();
+
+            return true;
+        }
+
+    private:
+        std::atomic<LogLevel>               _level;
+        std::atomic<uint64_t>               _nDroppedRecords;
+
+        // Rings live as long as the logger, records of exited threads are still written
+        std::vector<std::unique_ptr<Ring>>  _rings;
+        std::mutex                          _ringsMutex;
+
+        // Writer thread
+        std::vector<Line>                   _lines;
+        std::atomic<bool>                   _isRunning;
+        std::thread                         _writer;
+
+    };
+}
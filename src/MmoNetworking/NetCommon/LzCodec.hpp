@@ -0,0 +1,251 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+
+namespace NetCommon
+{
+    // Byte-oriented LZ77 block codec in the LZ4 block format
+    // Sequence: token (literal length << 4 | match length - 4), literals, 16-bit offset
+    struct LzCodec
+    {
+        static constexpr size_t     MinMatch        = 4;
+        static constexpr size_t     LastLiterals    = 5;
+        static constexpr size_t     MinInputSize    = 12;
+        static constexpr size_t     MaxOffset       = 65535;
+        static constexpr size_t     HashBits        = 12;
+
+        static size_t CalculateMaxCompressedSize(size_t size)
+        {
+            return size + size / 255 + 16;
+        }
+
+        // Compressed size, 0 if it does not fit in dstCapacity
+        static size_t Compress(const std::byte* pSrc, size_t srcSize, std::byte* pDst, size_t dstCapacity)
+        {
+            std::array<uint32_t, 1 << HashBits> table = {};
+            size_t anchor = 0;
+            size_t position = 0;
+            size_t dstSize = 0;
+
+            if (srcSize >= MinInputSize)
+            {
+                const size_t matchLimit = srcSize - LastLiterals;
+
+                while (position + MinInputSize <= srcSize)
+                {
+                    const uint32_t sequence = Read32(pSrc + position);
+                    uint32_t& entry = table[Hash(sequence)];
+                    const size_t candidate = entry;
+
+                    entry = static_cast<uint32_t>(position);
+
+                    if (candidate >= position ||
+                        position - candidate > MaxOffset ||
+                        Read32(pSrc + candidate) != sequence)
+                    {
+                        ++position;
+                        continue;
+                    }
+
+                    size_t matchLength = MinMatch;
+
+                    while (position + matchLength < matchLimit &&
+                           pSrc[candidate + matchLength] == pSrc[position + matchLength])
+                    {
+                        ++matchLength;
+                    }
+
+                    if (!WriteSequence(pSrc + anchor, position - anchor, 
+                                       position - candidate, matchLength, 
+                                       pDst, dstCapacity, dstSize))
+                    {
+                        return 0;
+                    }
+
+                    position += matchLength;
+                    anchor = position;
+                }
+            }
+
+            // The last sequence has literals only
+            if (!WriteSequence(pSrc + anchor, srcSize - anchor, 0, 0, pDst, dstCapacity, dstSize))
+            {
+                return 0;
+            }
+
+            return dstSize;
+        }
+
+        // False if the block is malformed or does not decode to exactly dstSize bytes
+        static bool Decompress(const std::byte* pSrc, size_t srcSize, std::byte* pDst, size_t dstSize)
+        {
+            size_t srcPosition = 0;
+            size_t dstPosition = 0;
+
+            while (srcPosition < srcSize)
+            {
+                const uint8_t token = static_cast<uint8_t>(pSrc[srcPosition++]);
+                size_t literalLength = token >> 4;
+
+                if (!ReadLength(pSrc, srcSize, srcPosition, literalLength) ||
+                    literalLength > srcSize - srcPosition ||
+                    literalLength > dstSize - dstPosition)
+                {
+                    return false;
+                }
+
+                if (literalLength > 0)
+                {
+                    std::memcpy(pDst + dstPosition, pSrc + srcPosition, literalLength);
+                }
+
+                srcPosition += literalLength;
+                dstPosition += literalLength;
+
+                if (srcPosition == srcSize)
+                {
+                    break;
+                }
+
+                if (srcSize - srcPosition < 2)
+                {
+                    return false;
+                }
+
+                const size_t offset = static_cast<size_t>(pSrc[srcPosition]) | 
+                                      (static_cast<size_t>(pSrc[srcPosition + 1]) << 8);
+                srcPosition += 2;
+
+                size_t matchLength = token & 0x0F;
+
+                if (offset == 0 ||
+                    offset > dstPosition ||
+                    !ReadLength(pSrc, srcSize, srcPosition, matchLength))
+                {
+                    return false;
+                }
+
+                matchLength += MinMatch;
+
+                if (matchLength > dstSize - dstPosition)
+                {
+                    return false;
+                }
+
+                // Byte by byte since the match may overlap its own output
+                for (size_t index = 0; index < matchLength; ++index)
+                {
+                    pDst[dstPosition] = pDst[dstPosition - offset];
+                    ++dstPosition;
+                }
+            }
+
+            return dstPosition == dstSize;
+        }
+
+    private:
+        static uint32_t Read32(const std::byte* pData)
+        {
+            uint32_t value;
+            std::memcpy(&value, pData, sizeof(value));
+
+            return value;
+        }
+
+        static size_t Hash(uint32_t sequence)
+        {
+            return (sequence * 2654435761u) >> (32 - HashBits);
+        }
+
+        static bool WriteByte(uint8_t value, std::byte* pDst, size_t dstCapacity, size_t& dstSize)
+        {
+            if (dstSize == dstCapacity)
+            {
+                return false;
+            }
+
+            pDst[dstSize++] = static_cast<std::byte>(value);
+
+            return true;
+        }
+
+        // Lengths of 15 or more continue in bytes of 255 and a final remainder
+        static bool WriteLength(size_t length, std::byte* pDst, size_t dstCapacity, size_t& dstSize)
+        {
+            if (length < 15)
+            {
+                return true;
+            }
+
+            length -= 15;
+
+            while (length >= 255)
+            {
+                if (!WriteByte(255, pDst, dstCapacity, dstSize))
+                {
+                    return false;
+                }
+
+                length -= 255;
+            }
+
+            return WriteByte(static_cast<uint8_t>(length), pDst, dstCapacity, dstSize);
+        }
+
+        static bool ReadLength(const std::byte* pSrc, size_t srcSize, size_t& srcPosition, size_t& length)
+        {
+            if (length < 15)
+            {
+                return true;
+            }
+
+            uint8_t value = 255;
+
+            while (value == 255)
+            {
+                if (srcPosition == srcSize)
+                {
+                    return false;
+                }
+
+                value = static_cast<uint8_t>(pSrc[srcPosition++]);
+                length += value;
+            }
+
+            return true;
+        }
+
+        // Match length 0 writes the last literals only sequence
+        static bool WriteSequence(const std::byte* pLiterals, size_t literalLength,
+                                  size_t offset, size_t matchLength,
+                                  std::byte* pDst, size_t dstCapacity, size_t& dstSize)
+        {
+            const size_t matchCode = (matchLength == 0) ? 0 : matchLength - MinMatch;
+            const uint8_t token = static_cast<uint8_t>((std::min<size_t>(literalLength, 15) << 4) | 
+                                                       std::min<size_t>(matchCode, 15));
+
+            if (!WriteByte(token, pDst, dstCapacity, dstSize) ||
+                !WriteLength(literalLength, pDst, dstCapacity, dstSize) ||
+                literalLength > dstCapacity - dstSize)
+            {
+                return false;
+            }
+
+            if (literalLength > 0)
+            {
+                std::memcpy(pDst + dstSize, pLiterals, literalLength);
+            }
+
+            dstSize += literalLength;
+
+            if (matchLength == 0)
+            {
+                return true;
+            }
+
+            return WriteByte(static_cast<uint8_t>(offset & 0xFF), pDst, dstCapacity, dstSize) &&
+                   WriteByte(static_cast<uint8_t>(offset >> 8), pDst, dstCapacity, dstSize) &&
+                   WriteLength(matchCode, pDst, dstCapacity, dstSize);
+        }
+    };
+}
@@ -0,0 +1,328 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+
+namespace NetCommon
+{
+    // Thread-local free lists of power-of-two size classes, a block goes back to the thread that allocated it
+    // Blocks freed on another thread are pushed to a lock-free return list of the owner, taken whole once its free list is empty
+    // A thread that exits orphans its return lists, blocks of it still out are deleted by the thread freeing them
+    class MemoryPool
+    {
+    public:
+        static constexpr size_t     MinBlockSize        = 64;
+        static constexpr size_t     MaxBlockSize        = 64 * 1024;
+        static constexpr size_t     MaxCachedBytes      = 1024 * 1024;
+
+    private:
+        static constexpr size_t     NumSizeClasses      = 11;
+        // The header keeps the block aligned as ::operator new does
+        static constexpr size_t     HeaderSize          = alignof(std::max_align_t);
+
+        static_assert((MinBlockSize << (NumSizeClasses - 1)) == MaxBlockSize, "Size classes must cover MaxBlockSize");
+
+        struct FreeBlock
+        {
+            FreeBlock*      pNext;
+        };
+
+        struct FreeList
+        {
+            FreeBlock*      pHead = nullptr;
+            size_t          nBlocks = 0;
+        };
+
+        // Outlives its thread while blocks of it are out, the thread and each block hold a reference
+        struct Owner
+        {
+            std::array<std::atomic<FreeBlock*>, NumSizeClasses>     returnedBlocks;
+            std::atomic<size_t>                                     nReferences;
+
+            Owner()
+                : nReferences(1)
+            {
+                for (std::atomic<FreeBlock*>& returned : returnedBlocks)
+                {
+                    returned.store(nullptr, std::memory_order_relaxed);
+                }
+            }
+        };
+
+        struct BlockHeader
+        {
+            Owner*          pOwner;
+        };
+
+        static_assert(sizeof(BlockHeader) <= HeaderSize, "The block header must fit in front of the block");
+
+        class ThreadCache
+        {
+        public:
+            explicit ThreadCache(bool& isDestroyed)
+                : _pOwner(new Owner())
+                , _isDestroyed(isDestroyed)
+            {}
+
+            ~ThreadCache()
+            {
+                _isDestroyed = true;
+
+                for (size_t sizeClass = 0; sizeClass < NumSizeClasses; ++sizeClass)
+                {
+                    DestroyBlocks(_pOwner->returnedBlocks[sizeClass].exchange(GetOrphanedMark(), std::memory_order_acquire));
+                    DestroyBlocks(_freeLists[sizeClass].pHead);
+                }
+
+                ReleaseOwner(_pOwner);
+            }
+
+            Owner* GetOwner() const
+            {
+                return _pOwner;
+            }
+
+            // Null if the free list and the return list are both empty
+            void* Pop(size_t sizeClass)
+            {
+                FreeList& freeList = _freeLists[sizeClass];
+
+                if (freeList.pHead == nullptr)
+                {
+                    freeList.pHead = _pOwner->returnedBlocks[sizeClass].exchange(nullptr, std::memory_order_acquire);
+
+                    for (FreeBlock* pBlock = freeList.pHead; pBlock != nullptr; pBlock = pBlock->pNext)
+                    {
+                        ++freeList.nBlocks;
+                    }
+
+                    if (freeList.pHead == nullptr)
+                    {
+                        return nullptr;
+                    }
+                }
+
+                FreeBlock* pBlock = freeList.pHead;
+                freeList.pHead = pBlock->pNext;
+                --freeList.nBlocks;
+
+                return pBlock;
+            }
+
+            void Push(size_t sizeClass, void* pMemory)
+            {
+                FreeList& freeList = _freeLists[sizeClass];
+
+                if (freeList.nBlocks * (MinBlockSize << sizeClass) >= MaxCachedBytes)
+                {
+                    DestroyBlock(pMemory);
+                    return;
+                }
+
+                FreeBlock* pBlock = static_cast<FreeBlock*>(pMemory);
+                pBlock->pNext = freeList.pHead;
+                freeList.pHead = pBlock;
+                ++freeList.nBlocks;
+            }
+
+        private:
+            static void DestroyBlocks(FreeBlock* pBlock)
+            {
+                while (pBlock != nullptr)
+                {
+                    FreeBlock* pNext = pBlock->pNext;
+                    DestroyBlock(pBlock);
+                    pBlock = pNext;
+                }
+            }
+
+        private:
+            std::array<FreeList, NumSizeClasses>    _freeLists;
+            Owner*                                  _pOwner;
+            bool&                                   _isDestroyed;
+
+        };
+
+    public:
+        // Size of the block actually handed out for the requested size
+        static size_t CalculateBlockSize(size_t size)
+        {
+            if (size > MaxBlockSize)
+            {
+                return size;
+            }
+
+            return MinBlockSize << CalculateSizeClass(size);
+        }
+
+        static void* Allocate(size_t size)
+        {
+            if (size > MaxBlockSize)
+            {
+                return ::operator new(size);
+            }
+
+            const size_t sizeClass = CalculateSizeClass(size);
+            ThreadCache* pThreadCache = GetThreadCache();
+
+            if (pThreadCache == nullptr)
+            {
+                return CreateBlock(sizeClass, nullptr);
+            }
+
+            void* pMemory = pThreadCache->Pop(sizeClass);
+
+            return (pMemory != nullptr) ? pMemory : CreateBlock(sizeClass, pThreadCache->GetOwner());
+        }
+
+        // Blocks may be returned from any thread, they go back to the thread that allocated them
+        static void Deallocate(void* pMemory, size_t size)
+        {
+            if (size > MaxBlockSize)
+            {
+                ::operator delete(pMemory);
+                return;
+            }
+
+            const size_t sizeClass = CalculateSizeClass(size);
+            Owner* pOwner = GetHeader(pMemory)->pOwner;
+            ThreadCache* pThreadCache = GetThreadCache();
+
+            if (pThreadCache != nullptr &&
+                pThreadCache->GetOwner() == pOwner)
+            {
+                pThreadCache->Push(sizeClass, pMemory);
+                return;
+            }
+
+            ReturnBlock(pOwner, sizeClass, pMemory);
+        }
+
+    private:
+        static size_t CalculateSizeClass(size_t size)
+        {
+            size_t sizeClass = 0;
+
+            while ((MinBlockSize << sizeClass) < size)
+            {
+                ++sizeClass;
+            }
+
+            return sizeClass;
+        }
+
+        // Null once the cache of the thread is destroyed, thread_local destructors running after it free to the owners directly
+        static ThreadCache* GetThreadCache()
+        {
+            thread_local bool isDestroyed = false;
+
+            if (isDestroyed)
+            {
+                return nullptr;
+            }
+
+            thread_local ThreadCache threadCache(isDestroyed);
+
+            return &threadCache;
+        }
+
+        // Head of an orphaned return list, never a block
+        static FreeBlock* GetOrphanedMark()
+        {
+            return reinterpret_cast<FreeBlock*>(alignof(FreeBlock));
+        }
+
+        static BlockHeader* GetHeader(void* pMemory)
+        {
+            return reinterpret_cast<BlockHeader*>(static_cast<std::byte*>(pMemory) - HeaderSize);
+        }
+
+        // Blocks of no owner are deleted when freed
+        static void* CreateBlock(size_t sizeClass, Owner* pOwner)
+        {
+            std::byte* pMemory = static_cast<std::byte*>(::operator new(HeaderSize + (MinBlockSize << sizeClass)));
+            new (pMemory) BlockHeader{pOwner};
+
+            if (pOwner != nullptr)
+            {
+                pOwner->nReferences.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            return pMemory + HeaderSize;
+        }
+
+        static void DestroyBlock(void* pMemory)
+        {
+            BlockHeader* pHeader = GetHeader(pMemory);
+            Owner* pOwner = pHeader->pOwner;
+
+            ::operator delete(pHeader);
+
+            if (pOwner != nullptr)
+            {
+                ReleaseOwner(pOwner);
+            }
+        }
+
+        static void ReleaseOwner(Owner* pOwner)
+        {
+            if (pOwner->nReferences.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                delete pOwner;
+            }
+        }
+
+        static void ReturnBlock(Owner* pOwner, size_t sizeClass, void* pMemory)
+        {
+            if (pOwner == nullptr)
+            {
+                DestroyBlock(pMemory);
+                return;
+            }
+
+            std::atomic<FreeBlock*>& returned = pOwner->returnedBlocks[sizeClass];
+            FreeBlock* pBlock = static_cast<FreeBlock*>(pMemory);
+            FreeBlock* pHead = returned.load(std::memory_order_relaxed);
+
+            do
+            {
+                if (pHead == GetOrphanedMark())
+                {
+                    DestroyBlock(pMemory);
+                    return;
+                }
+
+                pBlock->pNext = pHead;
+            } while (!returned.compare_exchange_weak(pHead, pBlock, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+    };
+
+    // Standard allocator over MemoryPool, e.g. for allocate_shared
+    template<typename T>
+    struct PoolAllocator
+    {
+        using value_type    = T;
+
+        PoolAllocator() = default;
+
+        template<typename U>
+        PoolAllocator(const PoolAllocator<U>&) noexcept
+        {}
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(MemoryPool::Allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, size_t n)
+        {
+            MemoryPool::Deallocate(p, n * sizeof(T));
+        }
+
+        template<typename U>
+        bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+
+        template<typename U>
+        bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+    };
+}
@@ -1,6 +1,8 @@
 ﻿#pragma once
 
 #include <NetCommon/Include.hpp>
+#include <NetCommon/Payload.hpp>
+#include <NetCommon/MpscQueue.hpp>
 
 namespace NetCommon
 {
@@ -8,7 +10,7 @@ namespace NetCommon
     {
         using Id            = uint32_t;
         using Size          = uint32_t;
-        using Payload       = std::vector<std::byte>;
+        using Payload       = NetCommon::Payload;
         using Buffer        = std::queue<Message>;
 
         struct Header
@@ -24,38 +26,6 @@ namespace NetCommon
         {
             return sizeof(Header) + payload.size();
         }
- 
-        // Push data to playload of message
-        template<typename TData>
-        friend Message& operator<<(Message& message, const TData& data)
-        {
-            static_assert(std::is_standard_layout<TData>::value, "Tdata must be standard-layout type");
-
-            const size_t offsetData = message.payload.size();
-
-            message.payload.resize(offsetData + sizeof(TData));
-            std::memcpy(message.payload.data() + offsetData, &data, sizeof(TData));
-
-            message.header.size = static_cast<Message::Size>(message.CalculateSize());
-
-            return message;
-        }
-
-        // Pop data from playload of message
-        template<typename TData>
-        friend Message& operator>>(Message& message, TData& data)
-        {
-            static_assert(std::is_standard_layout<TData>::value, "Tdata must be standard-layout type");
-
-            size_t offsetData = message.payload.size() - sizeof(TData);
-            
-            std::memcpy(&data, message.payload.data() + offsetData, sizeof(TData));
-            message.payload.resize(offsetData);
-
-            message.header.size = static_cast<Message::Size>(message.CalculateSize());
-
-            return message;
-        }
 
         friend std::ostream& operator<<(std::ostream& os, const Message& message)
         {
@@ -65,13 +35,14 @@ namespace NetCommon
         }
     };
 
-    template<typename TOwner>
+    // The owner is referred to by a handle, the message does not keep it alive
+    template<typename THandle>
     struct OwnedMessage
     {
-        using OwnerPointer      = std::shared_ptr<TOwner>;
         using Buffer            = std::queue<OwnedMessage>;
+        using Queue             = MpscQueue<OwnedMessage>;
 
-        OwnerPointer    pOwner = nullptr;
+        THandle         owner;
         Message         message;
 
         friend std::ostream& operator<<(std::ostream& os, const OwnedMessage& ownedMessage)
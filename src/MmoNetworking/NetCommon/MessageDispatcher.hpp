@@ -0,0 +1,146 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/Session.hpp>
+#include <NetCommon/ControlMessage.hpp>
+#include <NetCommon/FrameCodec.hpp>
+#include <NetCommon/MessageReader.hpp>
+
+namespace NetCommon
+{
+    // Dense table of message handlers indexed by message id, built at compile time
+    // TMessageId is an enum with the Begin and End of its id range
+    // Handlers are member functions of TService taking (SessionHandle), (SessionHandle, const TPayload&)
+    // or (SessionHandle, Message&&) to take the received message as is
+    template<typename TService, typename TMessageId>
+    class MessageDispatcher
+    {
+    public:
+        using OwnedMessage      = Session::OwnedMessage;
+
+    private:
+        using Handler           = bool (*)(TService&, OwnedMessage&);
+
+        static constexpr Message::Id    BeginId     = static_cast<Message::Id>(TMessageId::Begin);
+        static constexpr Message::Id    EndId       = static_cast<Message::Id>(TMessageId::End);
+        static constexpr size_t         TableSize   = EndId - BeginId;
+
+        static_assert(BeginId < EndId, "TMessageId must have a non-empty range");
+
+        template<typename TMethod>
+        struct HandlerTraits;
+
+        template<typename TClass>
+        struct HandlerTraits<void (TClass::*)(SessionHandle)>
+        {
+            template<auto Method>
+            static bool Invoke(TService& service, OwnedMessage& receivedMessage)
+            {
+                (service.*Method)(receivedMessage.owner);
+
+                return true;
+            }
+        };
+
+        template<typename TClass>
+        struct HandlerTraits<void (TClass::*)(SessionHandle, Message&&)>
+        {
+            template<auto Method>
+            static bool Invoke(TService& service, OwnedMessage& receivedMessage)
+            {
+                (service.*Method)(receivedMessage.owner, std::move(receivedMessage.message));
+
+                return true;
+            }
+        };
+
+        template<typename TClass, typename TPayload>
+        struct HandlerTraits<void (TClass::*)(SessionHandle, const TPayload&)>
+        {
+            template<auto Method>
+            static bool Invoke(TService& service, OwnedMessage& receivedMessage)
+            {
+                MessageReader reader(receivedMessage.message);
+                TPayload decoded;
+
+                if (!reader.Read(decoded) ||
+                    reader.GetRemainingSize() != 0)
+                {
+                    return false;
+                }
+
+                (service.*Method)(receivedMessage.owner, decoded);
+
+                return true;
+            }
+        };
+
+    public:
+        constexpr MessageDispatcher()
+            : _handlers{}
+        {}
+
+        // Registering an id twice or out of the range fails to compile in a constexpr table
+        template<TMessageId MessageId, auto Method>
+        constexpr MessageDispatcher Register() const
+        {
+            const Message::Id id = static_cast<Message::Id>(MessageId);
+
+            if (id < BeginId || id >= EndId)
+            {
+                throw std::out_of_range("Message id is out of the range");
+            }
+
+            if (_handlers[id - BeginId] != nullptr)
+            {
+                throw std::logic_error("Message id is already registered");
+            }
+
+            MessageDispatcher dispatcher = *this;
+            dispatcher._handlers[id - BeginId] = &HandlerTraits<decltype(Method)>::template Invoke<Method>;
+
+            return dispatcher;
+        }
+
+        // False if the message has no handler or its payload does not match
+        bool Dispatch(TService& service, OwnedMessage& receivedMessage) const
+        {
+            const Message::Id id = receivedMessage.message.header.id;
+
+            if (id < BeginId || id >= EndId)
+            {
+                return false;
+            }
+
+            const Handler handler = _handlers[id - BeginId];
+
+            if (handler == nullptr)
+            {
+                return false;
+            }
+
+            return handler(service, receivedMessage);
+        }
+
+    private:
+        std::array<Handler, TableSize>      _handlers;
+
+    };
+
+    // Id ranges of two message id enums must not overlap
+    template<typename TMessageIdA, typename TMessageIdB>
+    constexpr bool AreDisjointMessageIds()
+    {
+        return static_cast<Message::Id>(TMessageIdA::End) <= static_cast<Message::Id>(TMessageIdB::Begin) ||
+               static_cast<Message::Id>(TMessageIdB::End) <= static_cast<Message::Id>(TMessageIdA::Begin);
+    }
+
+    // Service ids must stay out of the control range and below the compressed flag the framing sets in the id
+    template<typename TMessageId>
+    constexpr bool AreServiceMessageIds()
+    {
+        return static_cast<Message::Id>(TMessageId::Begin) < static_cast<Message::Id>(TMessageId::End) &&
+               AreDisjointMessageIds<TMessageId, ControlMessageId>() &&
+               static_cast<Message::Id>(TMessageId::End) <= FrameCodec::CompressedIdFlag;
+    }
+}
@@ -0,0 +1,165 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/Message.hpp>
+#include <NetCommon/Varint.hpp>
+
+namespace NetCommon
+{
+    // Forward bounds-checked cursor reading fields from the payload of a message
+    // A failed read invalidates the reader and every following read fails
+    class MessageReader
+    {
+    public:
+        explicit MessageReader(const Message& message)
+            : _payload(message.payload)
+            , _offset(0)
+            , _isValid(true)
+        {}
+
+        template<typename TData>
+        MessageReader& operator>>(TData& data)
+        {
+            Read(data);
+
+            return *this;
+        }
+
+        template<typename TData>
+        bool Read(TData& data)
+        {
+            static_assert(std::is_trivially_copyable<TData>::value, "TData must be trivially copyable type");
+
+            return ReadBytes(&data, sizeof(TData));
+        }
+
+        bool ReadBytes(void* pData, size_t size)
+        {
+            if (!CanRead(size))
+            {
+                return false;
+            }
+
+            if (size > 0)
+            {
+                std::memcpy(pData, _payload.data() + _offset, size);
+                _offset += size;
+            }
+
+            return true;
+        }
+
+        template<typename TData>
+        bool ReadArray(std::vector<TData>& values)
+        {
+            static_assert(std::is_trivially_copyable<TData>::value, "TData must be trivially copyable type");
+
+            Message::Size count = 0;
+
+            if (!Read(count) ||
+                !CanRead(static_cast<size_t>(count) * sizeof(TData)))
+            {
+                return false;
+            }
+
+            values.resize(count);
+
+            return ReadBytes(values.data(), count * sizeof(TData));
+        }
+
+        bool ReadString(std::string& value)
+        {
+            Message::Size length = 0;
+
+            if (!Read(length) ||
+                !CanRead(length))
+            {
+                return false;
+            }
+
+            value.assign(reinterpret_cast<const char*>(_payload.data() + _offset), length);
+            _offset += length;
+
+            return true;
+        }
+
+        template<typename TInteger>
+        bool ReadVarint(TInteger& value)
+        {
+            static_assert(std::is_unsigned<TInteger>::value, "TInteger must be unsigned integer type");
+
+            uint64_t decoded = 0;
+            size_t decodedSize = 0;
+
+            if (!_isValid ||
+                !Varint::Decode(_payload.data() + _offset, GetRemainingSize(), decoded, decodedSize) ||
+                decodedSize == 0 ||
+                decoded > std::numeric_limits<TInteger>::max())
+            {
+                _isValid = false;
+                return false;
+            }
+
+            value = static_cast<TInteger>(decoded);
+            _offset += decodedSize;
+
+            return true;
+        }
+
+        bool ReadZigZag(int64_t& value)
+        {
+            uint64_t encoded = 0;
+
+            if (!ReadVarint(encoded))
+            {
+                return false;
+            }
+
+            value = Varint::DecodeZigZag(encoded);
+
+            return true;
+        }
+
+        bool ReadDelta(int64_t& value, int64_t baseValue)
+        {
+            int64_t delta = 0;
+
+            if (!ReadZigZag(delta))
+            {
+                return false;
+            }
+
+            value = static_cast<int64_t>(static_cast<uint64_t>(baseValue) + static_cast<uint64_t>(delta));
+
+            return true;
+        }
+
+        bool IsValid() const
+        {
+            return _isValid;
+        }
+
+        size_t GetRemainingSize() const
+        {
+            return _payload.size() - _offset;
+        }
+
+    private:
+        bool CanRead(size_t size)
+        {
+            if (!_isValid ||
+                size > GetRemainingSize())
+            {
+                _isValid = false;
+            }
+
+            return _isValid;
+        }
+
+    private:
+        const Message::Payload&     _payload;
+        size_t                      _offset;
+        bool                        _isValid;
+
+    };
+}
@@ -0,0 +1,148 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/Message.hpp>
+#include <NetCommon/Varint.hpp>
+
+namespace NetCommon
+{
+    // Forward cursor appending fields to the payload of a message
+    // The header size is patched once by Finish or on destruction
+    class MessageWriter
+    {
+    public:
+        explicit MessageWriter(Message& message, size_t reserveSize = 0)
+            : _message(message)
+            , _offset(message.payload.size())
+            , _isFinished(false)
+        {
+            _message.payload.reserve(_offset + reserveSize);
+        }
+
+        MessageWriter(const MessageWriter&) = delete;
+        MessageWriter& operator=(const MessageWriter&) = delete;
+
+        ~MessageWriter()
+        {
+            Finish();
+        }
+
+        template<typename TData>
+        MessageWriter& operator<<(const TData& data)
+        {
+            Write(data);
+
+            return *this;
+        }
+
+        template<typename TData>
+        void Write(const TData& data)
+        {
+            static_assert(std::is_trivially_copyable<TData>::value, "TData must be trivially copyable type");
+
+            WriteBytes(&data, sizeof(TData));
+        }
+
+        void WriteBytes(const void* pData, size_t size)
+        {
+            assert(!_isFinished);
+
+            if (size == 0)
+            {
+                return;
+            }
+
+            Ensure(size);
+            std::memcpy(_message.payload.data() + _offset, pData, size);
+            _offset += size;
+        }
+
+        void WriteZeros(size_t size)
+        {
+            assert(!_isFinished);
+
+            if (size == 0)
+            {
+                return;
+            }
+
+            Ensure(size);
+            std::memset(_message.payload.data() + _offset, 0, size);
+            _offset += size;
+        }
+
+        // Count prefixed array
+        template<typename TData>
+        void WriteArray(const TData* pData, size_t count)
+        {
+            static_assert(std::is_trivially_copyable<TData>::value, "TData must be trivially copyable type");
+
+            Write(static_cast<Message::Size>(count));
+            WriteBytes(pData, count * sizeof(TData));
+        }
+
+        template<typename TData>
+        void WriteArray(const std::vector<TData>& values)
+        {
+            WriteArray(values.data(), values.size());
+        }
+
+        // Length prefixed string without terminator
+        void WriteString(std::string_view value)
+        {
+            WriteArray(value.data(), value.size());
+        }
+
+        void WriteVarint(uint64_t value)
+        {
+            std::byte bytes[Varint::MaxSize64];
+
+            WriteBytes(bytes, Varint::Encode(value, bytes));
+        }
+
+        void WriteZigZag(int64_t value)
+        {
+            WriteVarint(Varint::EncodeZigZag(value));
+        }
+
+        // Difference from a value both sides know, small when the value changes little
+        // It wraps around in unsigned arithmetic, so values far apart do not overflow
+        void WriteDelta(int64_t value, int64_t baseValue)
+        {
+            WriteZigZag(static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(baseValue)));
+        }
+
+        void Finish()
+        {
+            if (_isFinished)
+            {
+                return;
+            }
+
+            _message.payload.resize(_offset);
+            _message.header.size = static_cast<Message::Size>(_message.CalculateSize());
+            _isFinished = true;
+        }
+
+    private:
+        // Grow the payload to its capacity at once, the unused tail is cut by Finish
+        void Ensure(size_t size)
+        {
+            Message::Payload& payload = _message.payload;
+
+            if (_offset + size <= payload.size())
+            {
+                return;
+            }
+
+            payload.resize(_offset + size);
+            payload.resize(payload.capacity());
+        }
+
+    private:
+        Message&        _message;
+        size_t          _offset;
+        bool            _isFinished;
+
+    };
+}
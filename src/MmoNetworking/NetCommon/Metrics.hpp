@@ -0,0 +1,211 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/ThreadIndex.hpp>
+#include <NetCommon/LatencyHistogram.hpp>
+
+namespace NetCommon
+{
+    // Value sharded per thread, Add never contends with other threads and Load sums the shards
+    template<typename TValue>
+    class ShardedValue
+    {
+    private:
+        static constexpr size_t     ShardCount  = 16;
+
+        struct alignas(64) Shard
+        {
+            std::atomic<TValue>     value{0};
+        };
+
+    public:
+        void Add(TValue value)
+        {
+            _shards[ThreadIndex::Get() % ShardCount].value.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        TValue Load() const
+        {
+            TValue sum = 0;
+
+            for (const Shard& shard : _shards)
+            {
+                sum += shard.value.load(std::memory_order_relaxed);
+            }
+
+            return sum;
+        }
+
+    private:
+        std::array<Shard, ShardCount>   _shards;
+
+    };
+
+    // Counters only grow, gauges go both ways
+    using Counter   = ShardedValue<uint64_t>;
+    using Gauge     = ShardedValue<int64_t>;
+
+    struct ServiceMetrics
+    {
+        // Traffic
+        Counter                     nBytesReceived;
+        Counter                     nBytesSent;
+        Counter                     nMessagesReceived;
+        Counter                     nMessagesSent;
+
+        // Datagrams: packets, reliable entries resent, packets and messages dropped on receive, packets failed to send
+        Counter                     nDatagramsReceived;
+        Counter                     nDatagramsSent;
+        Counter                     nDatagramBytesReceived;
+        Counter                     nDatagramBytesSent;
+        Counter                     nDatagramResends;
+        Counter                     nDroppedDatagrams;
+        Counter                     nDroppedDatagramMessages;
+        Counter                     nFailedDatagramSends;
+
+        // Messages received but not handled yet, frames pushed but not written yet
+        Gauge                       receiveQueueDepth;
+        Gauge                       sendQueueDepth;
+
+        // Sessions not reading until the logic shard catches up with their messages
+        Gauge                       nReadPausedSessions;
+
+        // Backpressure: bytes pushed but not written yet, sessions over their send queue watermarks
+        Gauge                       sendQueueBytes;
+        Gauge                       nPressuredSessions;
+        Counter                     nDroppedFrames;
+        Counter                     nSlowConsumerDisconnects;
+
+        // Sessions
+        Gauge                       nActiveSessions;
+        Counter                     nOpenedSessions;
+        Counter                     nClosedSessions;
+        Counter                     nIdleTimeouts;
+
+        // Client connects
+        Gauge                       nPendingConnects;
+        Counter                     nConnects;
+        Counter                     nConnectFailures;
+        Counter                     nReconnects;
+
+        // Update loop, in microseconds
+        ShardedLatencyHistogram     tickDurations;
+
+        explicit ServiceMetrics(size_t nShards)
+            : tickDurations(nShards)
+        {}
+    };
+
+    // Renders the metrics as plain text "name value" lines, rates are per second since the previous report
+    // Not thread-safe, called from one chain only
+    class MetricsReporter
+    {
+    private:
+        using Clock         = std::chrono::steady_clock;
+        using TimePoint     = Clock::time_point;
+        using Seconds       = std::chrono::duration<double>;
+
+        struct Totals
+        {
+            uint64_t    nBytesReceived      = 0;
+            uint64_t    nBytesSent          = 0;
+            uint64_t    nMessagesReceived   = 0;
+            uint64_t    nMessagesSent       = 0;
+            uint64_t    nOpenedSessions     = 0;
+            uint64_t    nClosedSessions     = 0;
+            uint64_t    nConnects           = 0;
+            uint64_t    nConnectFailures    = 0;
+            uint64_t    nDroppedFrames      = 0;
+            uint64_t    nDatagramsReceived  = 0;
+            uint64_t    nDatagramsSent      = 0;
+        };
+
+    public:
+        explicit MetricsReporter(ServiceMetrics& metrics)
+            : _metrics(metrics)
+            , _lastReportTime(Clock::now())
+        {}
+
+        std::string Report(uint32_t tickRate)
+        {
+            const TimePoint now = Clock::now();
+            const double elapsed = std::max(Seconds(now - _lastReportTime).count(), 1e-3);
+
+            Totals totals;
+            totals.nBytesReceived = _metrics.nBytesReceived.Load();
+            totals.nBytesSent = _metrics.nBytesSent.Load();
+            totals.nMessagesReceived = _metrics.nMessagesReceived.Load();
+            totals.nMessagesSent = _metrics.nMessagesSent.Load();
+            totals.nOpenedSessions = _metrics.nOpenedSessions.Load();
+            totals.nClosedSessions = _metrics.nClosedSessions.Load();
+            totals.nConnects = _metrics.nConnects.Load();
+            totals.nConnectFailures = _metrics.nConnectFailures.Load();
+            totals.nDroppedFrames = _metrics.nDroppedFrames.Load();
+            totals.nDatagramsReceived = _metrics.nDatagramsReceived.Load();
+            totals.nDatagramsSent = _metrics.nDatagramsSent.Load();
+
+            LatencyHistogram tickDurations;
+            _metrics.tickDurations.Collect(tickDurations);
+
+            auto rate = [elapsed](uint64_t current, uint64_t last)
+                        {
+                            return static_cast<uint64_t>((current - last) / elapsed);
+                        };
+
+            std::ostringstream os;
+            os << "sessions_active " << _metrics.nActiveSessions.Load() << "\n"
+               << "sessions_opened_total " << totals.nOpenedSessions << "\n"
+               << "sessions_opened_per_sec " << rate(totals.nOpenedSessions, _lastTotals.nOpenedSessions) << "\n"
+               << "sessions_closed_total " << totals.nClosedSessions << "\n"
+               << "sessions_closed_per_sec " << rate(totals.nClosedSessions, _lastTotals.nClosedSessions) << "\n"
+               << "idle_timeouts_total " << _metrics.nIdleTimeouts.Load() << "\n"
+               << "connects_pending " << _metrics.nPendingConnects.Load() << "\n"
+               << "connects_total " << totals.nConnects << "\n"
+               << "connects_per_sec " << rate(totals.nConnects, _lastTotals.nConnects) << "\n"
+               << "connect_failures_total " << totals.nConnectFailures << "\n"
+               << "connect_failures_per_sec " << rate(totals.nConnectFailures, _lastTotals.nConnectFailures) << "\n"
+               << "reconnects_total " << _metrics.nReconnects.Load() << "\n"
+               << "bytes_received_total " << totals.nBytesReceived << "\n"
+               << "bytes_received_per_sec " << rate(totals.nBytesReceived, _lastTotals.nBytesReceived) << "\n"
+               << "bytes_sent_total " << totals.nBytesSent << "\n"
+               << "bytes_sent_per_sec " << rate(totals.nBytesSent, _lastTotals.nBytesSent) << "\n"
+               << "messages_received_total " << totals.nMessagesReceived << "\n"
+               << "messages_received_per_sec " << rate(totals.nMessagesReceived, _lastTotals.nMessagesReceived) << "\n"
+               << "messages_sent_total " << totals.nMessagesSent << "\n"
+               << "messages_sent_per_sec " << rate(totals.nMessagesSent, _lastTotals.nMessagesSent) << "\n"
+               << "datagrams_received_total " << totals.nDatagramsReceived << "\n"
+               << "datagrams_received_per_sec " << rate(totals.nDatagramsReceived, _lastTotals.nDatagramsReceived) << "\n"
+               << "datagrams_sent_total " << totals.nDatagramsSent << "\n"
+               << "datagrams_sent_per_sec " << rate(totals.nDatagramsSent, _lastTotals.nDatagramsSent) << "\n"
+               << "datagram_bytes_received_total " << _metrics.nDatagramBytesReceived.Load() << "\n"
+               << "datagram_bytes_sent_total " << _metrics.nDatagramBytesSent.Load() << "\n"
+               << "datagram_resends_total " << _metrics.nDatagramResends.Load() << "\n"
+               << "datagrams_dropped_total " << _metrics.nDroppedDatagrams.Load() << "\n"
+               << "datagram_messages_dropped_total " << _metrics.nDroppedDatagramMessages.Load() << "\n"
+               << "datagram_send_failures_total " << _metrics.nFailedDatagramSends.Load() << "\n"
+               << "receive_queue_depth " << _metrics.receiveQueueDepth.Load() << "\n"
+               << "sessions_read_paused " << _metrics.nReadPausedSessions.Load() << "\n"
+               << "send_queue_depth " << _metrics.sendQueueDepth.Load() << "\n"
+               << "send_queue_bytes " << _metrics.sendQueueBytes.Load() << "\n"
+               << "sessions_under_pressure " << _metrics.nPressuredSessions.Load() << "\n"
+               << "send_dropped_total " << totals.nDroppedFrames << "\n"
+               << "send_dropped_per_sec " << rate(totals.nDroppedFrames, _lastTotals.nDroppedFrames) << "\n"
+               << "slow_consumer_disconnects_total " << _metrics.nSlowConsumerDisconnects.Load() << "\n"
+               << "tick_rate " << tickRate << "\n"
+               << "tick_duration_us_p50 " << tickDurations.CalculatePercentile(50.0) << "\n"
+               << "tick_duration_us_p99 " << tickDurations.CalculatePercentile(99.0) << "\n"
+               << "tick_duration_us_max " << tickDurations.GetMax() << "\n";
+
+            _lastTotals = totals;
+            _lastReportTime = now;
+
+            return os.str();
+        }
+
+    private:
+        ServiceMetrics&     _metrics;
+        Totals              _lastTotals;
+        TimePoint           _lastReportTime;
+
+    };
+}
@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/MemoryPool.hpp>
+
+namespace NetCommon
+{
+    // Lock-free multi-producer single-consumer queue (Vyukov)
+    // Push may be called from any thread, TryPop only from one consumer at a time
+    template<typename T>
+    class MpscQueue
+    {
+    private:
+        struct Node
+        {
+            std::atomic<Node*>                                      pNext;
+            std::aligned_storage_t<sizeof(T), alignof(T)>           storage;
+
+            Node()
+                : pNext(nullptr)
+            {}
+
+            T& GetValue()
+            {
+                return *std::launder(reinterpret_cast<T*>(&storage));
+            }
+        };
+
+        using NodeAllocator     = PoolAllocator<Node>;
+
+    public:
+        MpscQueue()
+            : _pHead(CreateNode())
+            , _pTail(_pHead.load(std::memory_order_relaxed))
+        {}
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        ~MpscQueue()
+        {
+            T value;
+            while (TryPop(value))
+            {}
+
+            DestroyNode(_pTail);
+        }
+
+        template<typename... TArgs>
+        void Emplace(TArgs&&... args)
+        {
+            Node* pNode = CreateNode();
+            new (&pNode->storage) T(std::forward<TArgs>(args)...);
+
+            Node* pPrev = _pHead.exchange(pNode, std::memory_order_acq_rel);
+            pPrev->pNext.store(pNode, std::memory_order_release);
+        }
+
+        void Push(T&& value)
+        {
+            Emplace(std::move(value));
+        }
+
+        // May miss an element whose push is still in progress, it is popped on a later call
+        bool TryPop(T& value)
+        {
+            Node* pTail = _pTail;
+            Node* pNext = pTail->pNext.load(std::memory_order_acquire);
+
+            if (pNext == nullptr)
+            {
+                return false;
+            }
+
+            // The next node becomes the new stub after its value is moved out
+            value = std::move(pNext->GetValue());
+            pNext->GetValue().~T();
+
+            _pTail = pNext;
+            DestroyNode(pTail);
+
+            return true;
+        }
+
+    private:
+        static Node* CreateNode()
+        {
+            NodeAllocator allocator;
+            Node* pNode = allocator.allocate(1);
+
+            return new (pNode) Node();
+        }
+
+        static void DestroyNode(Node* pNode)
+        {
+            NodeAllocator allocator;
+
+            pNode->~Node();
+            allocator.deallocate(pNode, 1);
+        }
+
+    private:
+        // Producers and the consumer touch different cache lines
+        alignas(64) std::atomic<Node*>      _pHead;
+        alignas(64) Node*                   _pTail;
+
+    };
+}
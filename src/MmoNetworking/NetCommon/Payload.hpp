@@ -0,0 +1,178 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/MemoryPool.hpp>
+
+namespace NetCommon
+{
+    // Byte buffer with the std::vector interface used by Message
+    // Small payloads are stored inline, bigger ones in blocks of MemoryPool
+    class Payload
+    {
+    public:
+        static constexpr size_t     InlineCapacity      = 64;
+
+        using value_type        = std::byte;
+        using iterator          = std::byte*;
+        using const_iterator    = const std::byte*;
+
+    public:
+        Payload() noexcept
+            : _pData(_inlineData)
+            , _size(0)
+            , _capacity(InlineCapacity)
+        {}
+
+        Payload(const Payload& other)
+            : Payload()
+        {
+            assign(other.begin(), other.end());
+        }
+
+        Payload(Payload&& other) noexcept
+            : Payload()
+        {
+            MoveFrom(std::move(other));
+        }
+
+        ~Payload()
+        {
+            Release();
+        }
+
+        Payload& operator=(const Payload& other)
+        {
+            if (this != &other)
+            {
+                assign(other.begin(), other.end());
+            }
+
+            return *this;
+        }
+
+        Payload& operator=(Payload&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Release();
+                MoveFrom(std::move(other));
+            }
+
+            return *this;
+        }
+
+        std::byte* data() { return _pData; }
+        const std::byte* data() const { return _pData; }
+        size_t size() const { return _size; }
+        size_t capacity() const { return _capacity; }
+        bool empty() const { return _size == 0; }
+
+        iterator begin() { return _pData; }
+        iterator end() { return _pData + _size; }
+        const_iterator begin() const { return _pData; }
+        const_iterator end() const { return _pData + _size; }
+
+        void reserve(size_t capacity)
+        {
+            if (capacity <= _capacity)
+            {
+                return;
+            }
+
+            const size_t newCapacity = MemoryPool::CalculateBlockSize(capacity);
+            std::byte* pNewData = static_cast<std::byte*>(MemoryPool::Allocate(newCapacity));
+
+            const size_t size = _size;
+
+            std::memcpy(pNewData, _pData, size);
+            Release();
+
+            _pData = pNewData;
+            _size = size;
+            _capacity = newCapacity;
+        }
+
+        void resize(size_t size)
+        {
+            if (size > _capacity)
+            {
+                reserve(std::max(size, _capacity * 2));
+            }
+
+            if (size > _size)
+            {
+                std::memset(_pData + _size, 0, size - _size);
+            }
+
+            _size = size;
+        }
+
+        void assign(const std::byte* pFirst, const std::byte* pLast)
+        {
+            const size_t size = static_cast<size_t>(pLast - pFirst);
+
+            _size = 0;
+            reserve(size);
+
+            if (size > 0)
+            {
+                std::memcpy(_pData, pFirst, size);
+            }
+
+            _size = size;
+        }
+
+        void clear()
+        {
+            _size = 0;
+        }
+
+    private:
+        bool IsInline() const
+        {
+            return _pData == _inlineData;
+        }
+
+        void Release()
+        {
+            if (!IsInline())
+            {
+                MemoryPool::Deallocate(_pData, _capacity);
+            }
+
+            _pData = _inlineData;
+            _size = 0;
+            _capacity = InlineCapacity;
+        }
+
+        // Steal the pooled block or copy the inline bytes, this must be empty
+        void MoveFrom(Payload&& other)
+        {
+            assert(IsInline());
+
+            if (other.IsInline())
+            {
+                std::memcpy(_inlineData, other._inlineData, other._size);
+                _size = other._size;
+            }
+            else
+            {
+                _pData = other._pData;
+                _size = other._size;
+                _capacity = other._capacity;
+
+                other._pData = other._inlineData;
+                other._capacity = InlineCapacity;
+            }
+
+            other._size = 0;
+        }
+
+    private:
+        std::byte*      _pData;
+        size_t          _size;
+        size_t          _capacity;
+        std::byte       _inlineData[InlineCapacity];
+
+    };
+}
@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+
+namespace NetCommon
+{
+    // Contiguous receive buffer filled by read_some and drained frame by frame
+    class ReadBuffer
+    {
+    private:
+        using Bytes         = std::vector<std::byte>;
+
+    public:
+        explicit ReadBuffer(size_t capacity)
+            : _bytes(capacity)
+            , _readOffset(0)
+            , _writeOffset(0)
+        {
+            assert(capacity > 0);
+        }
+
+        // Free space after the unread bytes
+        boost::asio::mutable_buffer Prepare()
+        {
+            if (_writeOffset == _bytes.size())
+            {
+                Compact();
+            }
+
+            return boost::asio::buffer(_bytes.data() + _writeOffset, _bytes.size() - _writeOffset);
+        }
+
+        void Commit(size_t nBytes)
+        {
+            assert(_writeOffset + nBytes <= _bytes.size());
+
+            _writeOffset += nBytes;
+        }
+
+        void Consume(size_t nBytes)
+        {
+            assert(nBytes <= GetSize());
+
+            _readOffset += nBytes;
+
+            if (_readOffset == _writeOffset)
+            {
+                _readOffset = 0;
+                _writeOffset = 0;
+            }
+        }
+
+        // Drop the unread bytes and shrink back to the capacity if a big frame grew the buffer
+        void Reset(size_t capacity)
+        {
+            assert(capacity > 0);
+
+            _readOffset = 0;
+            _writeOffset = 0;
+
+            if (_bytes.size() > capacity)
+            {
+                Bytes(capacity).swap(_bytes);
+            }
+        }
+
+        // Make room for a frame bigger than the free space, keeping unread bytes
+        void Reserve(size_t nBytes)
+        {
+            if (_readOffset + nBytes <= _bytes.size())
+            {
+                return;
+            }
+
+            Compact();
+
+            if (nBytes > _bytes.size())
+            {
+                _bytes.resize(nBytes);
+            }
+        }
+
+        const std::byte* GetData() const
+        {
+            return _bytes.data() + _readOffset;
+        }
+
+        size_t GetSize() const
+        {
+            return _writeOffset - _readOffset;
+        }
+
+    private:
+        // Move unread bytes to the front
+        void Compact()
+        {
+            const size_t size = GetSize();
+
+            if (_readOffset > 0)
+            {
+                std::memmove(_bytes.data(), _bytes.data() + _readOffset, size);
+            }
+
+            _readOffset = 0;
+            _writeOffset = size;
+        }
+
+    private:
+        Bytes       _bytes;
+        size_t      _readOffset;
+        size_t      _writeOffset;
+
+    };
+}
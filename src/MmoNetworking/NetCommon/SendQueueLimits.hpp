@@ -0,0 +1,32 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+
+namespace NetCommon
+{
+    // What a session does with its send queue once it is over the high watermark
+    enum class SlowConsumerPolicy
+    {
+        // Drop the oldest droppable frames until it is back under the high watermark
+        DropOldest,
+        // Drop the droppable frames pushed while it is over the high watermark
+        DropNewest,
+        // Keep every frame, the grace period decides when the session is closed
+        Disconnect,
+    };
+
+    // Watermarks of the send queue of a session, counting the frames being written as well, 0 disables a watermark
+    // Pressure starts over any high watermark and ends once under every low watermark
+    struct SendQueueLimits
+    {
+        using MilliSeconds      = std::chrono::milliseconds;
+
+        size_t              nHighWatermarkBytes     = 4 * 1024 * 1024;
+        size_t              nLowWatermarkBytes      = 1024 * 1024;
+        size_t              nHighWatermarkMessages  = 8192;
+        size_t              nLowWatermarkMessages   = 2048;
+        SlowConsumerPolicy  policy                  = SlowConsumerPolicy::DropOldest;
+        // A session staying over the high watermark for longer is closed, frames not droppable keep it over with any policy
+        MilliSeconds        gracePeriod             = MilliSeconds(5000);
+    };
+}
@@ -4,46 +4,123 @@
 
 namespace NetCommon
 {
+    // Listens with nAcceptors sockets on the port, the kernel spreads the incoming connections over them
+    // Each acceptor has its own strand and keeps nPendingAccepts accepts outstanding
     class ServerServiceBase : public ServiceBase
     {
+    private:
+#if defined(SO_REUSEPORT)
+        using ReusePort     = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+        struct Acceptor
+        {
+            using Pointer   = std::unique_ptr<Acceptor>;
+            using Vector    = std::vector<Pointer>;
+
+            Strand          strand;
+            Tcp::acceptor   acceptor;
+
+            explicit Acceptor(const Executor& executor)
+                : strand(boost::asio::make_strand(executor))
+                , acceptor(strand)
+            {}
+        };
+
     public:
-        ServerServiceBase(size_t nWorkers, 
-                          size_t nMaxReceivedMessages,
+        ServerServiceBase(const ServiceConfig& config,
                           uint16_t port)
-            : ServiceBase(nWorkers, nMaxReceivedMessages)
-            , _acceptor(_workers, Tcp::endpoint(Tcp::v4(), port))
-        {}
+            : ServiceBase(config)
+        {
+            InitAcceptors(port);
+
+            if (HasFeature(config.sessionFeatures, SessionFeature::Datagram))
+            {
+                OpenDatagramEndpoint(config.datagramPort, true);
+            }
+        }
 
+        // The workers already run, so the first accepts are started on the strand that re-arms them
         void Start()
         {
-            AcceptAsync();
-            std::cout << "[SERVER] Started!\n";
+            for (Acceptor::Pointer& pAcceptor : _acceptors)
+            {
+                boost::asio::post(pAcceptor->strand,
+                                  [this, &acceptor = *pAcceptor]()
+                                  {
+                                      for (size_t i = 0; i < std::max<size_t>(1, _config.nPendingAccepts); ++i)
+                                      {
+                                          AcceptAsync(acceptor);
+                                      }
+                                  });
+            }
+
+            Logger::Info("[SERVER] Started! Acceptors: ", _acceptors.size());
         }
 
     private:
-        void AcceptAsync()
+        void InitAcceptors(uint16_t port)
+        {
+            size_t nAcceptors = std::max<size_t>(1, _config.nAcceptors);
+
+#if !defined(SO_REUSEPORT)
+            if (nAcceptors > 1)
+            {
+                Logger::Warning("[SERVER] SO_REUSEPORT is not supported, falling back to a single acceptor");
+                nAcceptors = 1;
+            }
+#endif
+
+            for (size_t i = 0; i < nAcceptors; ++i)
+            {
+                _acceptors.emplace_back(std::make_unique<Acceptor>(_workers.GetExecutor()));
+                OpenAcceptor(_acceptors.back()->acceptor, port, nAcceptors > 1);
+            }
+        }
+
+        static void OpenAcceptor(Tcp::acceptor& acceptor, uint16_t port, bool shouldReusePort)
+        {
+            const Tcp::endpoint endpoint(Tcp::v4(), port);
+
+            acceptor.open(endpoint.protocol());
+            acceptor.set_option(Tcp::acceptor::reuse_address(true));
+
+#if defined(SO_REUSEPORT)
+            if (shouldReusePort)
+            {
+                acceptor.set_option(ReusePort(true));
+            }
+#endif
+
+            acceptor.bind(endpoint);
+            acceptor.listen(Tcp::acceptor::max_listen_connections);
+        }
+
+        // Accepted sockets run on the workers, not on the strand of the acceptor, in turn on each core in IoContextPerCore
+        void AcceptAsync(Acceptor& acceptor)
         {
-            _acceptor.async_accept([this](const ErrorCode& error,
-                                          Tcp::socket socket)
-                                   {
-                                       OnAcceptCompleted(error, std::move(socket));
-                                   });
+            acceptor.acceptor.async_accept(_workers.GetExecutor(),
+                                           [this, &acceptor](const ErrorCode& error,
+                                                             Tcp::socket socket)
+                                           {
+                                               OnAcceptCompleted(error, acceptor, std::move(socket));
+                                           });
         }
 
-        void OnAcceptCompleted(const ErrorCode& error, Tcp::socket&& socket)
+        void OnAcceptCompleted(const ErrorCode& error, Acceptor& acceptor, Tcp::socket&& socket)
         {
             if (error)
             {
-                std::cerr << "[SERVER] Failed to accept: " << error << "\n";
+                Logger::Error("[SERVER] Failed to accept: ", error);
                 return;
             }
 
+            AcceptAsync(acceptor);
             CreateSession(std::move(socket));
-            AcceptAsync();
         }
 
-    protected:
-        Tcp::acceptor       _acceptor;
+    private:
+        Acceptor::Vector    _acceptors;
 
     };
 }
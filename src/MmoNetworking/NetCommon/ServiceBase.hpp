@@ -1,38 +1,141 @@
 ﻿#pragma once
 
 #include <NetCommon/Session.hpp>
+#include <NetCommon/SessionPool.hpp>
+#include <NetCommon/SessionRegistry.hpp>
+#include <NetCommon/ServiceConfig.hpp>
+#include <NetCommon/Metrics.hpp>
+#include <NetCommon/StatsEndpoint.hpp>
+#include <NetCommon/TimingWheel.hpp>
+#include <NetCommon/DatagramEndpoint.hpp>
 
 namespace NetCommon
 {
     class ServiceBase
     {
     protected:
-        using ThreadPool            = boost::asio::thread_pool;
-        using WorkGuard             = boost::asio::executor_work_guard<ThreadPool::executor_type>;
-        using Strand                = boost::asio::strand<ThreadPool::executor_type>;
+        using Executor              = Workers::Executor;
+        using Strand                = boost::asio::strand<Executor>;
         using Timer                 = boost::asio::steady_timer;
         using Seconds               = std::chrono::seconds;
         using MicroSeconds          = std::chrono::microseconds;
+        using Clock                 = std::chrono::steady_clock;
+        using TimePoint             = Clock::time_point;
         using TickRate              = uint32_t;
         using ErrorCode             = boost::system::error_code;
         using Tcp                   = boost::asio::ip::tcp;
         using SessionPointer        = Session::Pointer;
         using SessionId             = Session::Id;
-        using SessionMap            = std::unordered_map<SessionId, SessionPointer>;
+        using SessionHandle         = NetCommon::SessionHandle;
         using OwnedMessage          = Session::OwnedMessage;
         using OwnedMessageBuffer    = Session::OwnedMessageBuffer;
+        using OwnedMessageQueue     = Session::OwnedMessageQueue;
+        using ShardTask             = std::function<void()>;
+        using TimerId               = TimingWheel::TimerId;
+        using TimerCallback         = TimingWheel::Callback;
+
+        // Logic loop owning the messages of the sessions hashed to it
+        struct LogicShard
+        {
+            using Pointer       = std::unique_ptr<LogicShard>;
+            using Vector        = std::vector<Pointer>;
+            using TaskQueue     = MpscQueue<ShardTask>;
+            using InboundMap    = std::unordered_map<SessionHandle, OwnedMessageBuffer>;
+            using SessionRing   = std::deque<SessionHandle>;
+
+            const size_t            index;
+            OwnedMessageQueue       receiveQueue;
+            TaskQueue               taskQueue;
+
+            // Fetched messages per session, the sessions with messages wait in the ring for their turn
+            InboundMap              inboundMessages;
+            SessionRing             pendingSessions;
+
+            // Timers of the shard, fired at the start of its ticks
+            TimingWheel             timers;
+
+            // Tick scheduling, set once OnReceivedMessagesDispatched stops the update loop
+            Timer                   tickTimer;
+            TimePoint               tickDeadline;
+            std::atomic<bool>       isStopped;
+
+            LogicShard(size_t index, const Executor& executor)
+                : index(index)
+                , tickTimer(executor)
+                , tickDeadline(Clock::now())
+                , isStopped(false)
+            {}
+        };
+
+        // Release of a registry slot waiting for every logic shard, each shard passes once
+        struct PendingRelease
+        {
+            const SessionHandle                     handle;
+            std::atomic<size_t>                     nPendingShards;
+            std::unique_ptr<std::atomic<bool>[]>    hasShardPassed;
+
+            PendingRelease(SessionHandle handle, size_t nShards)
+                : handle(handle)
+                , nPendingShards(nShards)
+                , hasShardPassed(new std::atomic<bool>[nShards]())
+            {}
+        };
 
     public:
-        ServiceBase(size_t nWorkers, size_t nMaxReceivedMessages)
-            : _workers(nWorkers)
-            , _workGuard(boost::asio::make_work_guard(_workers))
-            , _sessionsStrand(boost::asio::make_strand(_workers))
-            , _tickRateTimer(_workers)
+        // Each logic shard runs its own update loop, so HandleReceivedMessage is called 
+        // concurrently when nLogicShards > 1. Messages of a session are always handled in order by one shard
+        explicit ServiceBase(const ServiceConfig& config)
+            : _config(config)
+            , _metrics(config.nWorkers)
+            , _workers(config.executionModel, config.nWorkers, config.shouldPinWorkers)
+            , _sessions(config.nMaxSessions)
+            , _sessionsStrand(boost::asio::make_strand(_workers.GetExecutor()))
+            , _sessionPool(_workers,
+                           [this](SessionPointer pSession)
+                           {
+                               boost::asio::post(_sessionsStrand,
+                                                 [this, pSession = std::move(pSession)]() mutable
+                                                 {
+                                                     UnregisterSession(std::move(pSession));
+                                                 });
+                           },
+                           [this](SessionPointer pSession, bool isUnderPressure)
+                           {
+                               OnSendQueuePressure(std::move(pSession), isUnderPressure);
+                           },
+                           [this](SessionPointer pSession, uint64_t token, uint16_t port)
+                           {
+                               OnDatagramBound(std::move(pSession), token, port);
+                           },
+                           config.sessionFeatures,
+                           config.compressionThreshold,
+                           config.sendQueueLimits,
+                           config.nMaxInboundMessages,
+                           _metrics,
+                           config.nMaxPooledSessions)
+            , _nextSessionId(10000)
+            , _tickRateTimer(_workers.GetExecutor())
             , _tickRate(0)
-            , _receiveStrand(boost::asio::make_strand(_workers))
-            , _nMaxReceivedMessages(nMaxReceivedMessages)
+            , _tickInterval(CalculateTickInterval(config.tickRate))
+            , _timersStart(Clock::now())
+            , _shouldIssueDatagramTokens(false)
+            , _metricsReporter(_metrics)
+            , _hasSnapshotFailed(false)
         {
-            UpdateAsync();
+            _sessionPool.Reserve(config.nWarmSessions);
+
+            if (config.statsPort != 0)
+            {
+                _pStatsEndpoint = std::make_unique<StatsEndpoint>(_workers.GetExecutor(), config.statsPort);
+            }
+
+            InitLogicShards(config.nLogicShards);
+
+            for (LogicShard::Pointer& pShard : _logicShards)
+            {
+                UpdateAsync(*pShard);
+            }
+
             WaitTickRateTimerAsync();
         }
 
@@ -41,51 +144,46 @@ namespace NetCommon
 
         void StopWorkers()
         {
-            _workers.stop();
+            _workers.Stop();
         }
 
         void JoinWorkers()
         {
-            _workers.join();
+            _workers.Join();
         }
 
     protected:
+        // Called on the strand of the acceptor or connector that created the session, concurrently with several acceptors
         virtual SessionPointer OnSessionCreated(SessionPointer pSession, bool& isDenied) { return pSession; }
         virtual void OnSessionRegistered(SessionPointer pSession) {}
+        // Also called for a session that found no free slot in the registry, its handle is invalid
         virtual void OnSessionUnregistered(SessionPointer pSession) {}
+        // Called on the send strand of the session when its send queue goes over a high watermark, 
+        // and again with false once it is back under the low watermarks
+        virtual void OnSendQueuePressure(SessionPointer pSession, bool isUnderPressure) {}
         virtual void HandleReceivedMessage(OwnedMessage receivedMessage) {}
         virtual bool OnReceivedMessagesDispatched() { return true; }
         virtual void OnTickRateMeasured(const TickRate tickRate) {}
 
-        void CreateSession(Tcp::socket&& socket)
-        {
-            auto onSessionClosed = [this](SessionPointer pSession)
-                                   {
-                                       boost::asio::post(_sessionsStrand,
-                                                         [this, pSession = std::move(pSession)]() mutable
-                                                         {
-                                                             UnregisterSession(std::move(pSession));
-                                                         });
-                                   };
-
-            SessionPointer pSession = Session::Create(_workers,
-                                                      std::move(socket),
-                                                      AssignId(),
-                                                      std::move(onSessionClosed),
-                                                      _receiveBuffer,
-                                                      _receiveStrand);
-            std::cout << pSession << " Session created: " << pSession->GetEndpoint() << "\n";
+        // Null when OnSessionCreated denies the session
+        SessionPointer CreateSession(Tcp::socket&& socket)
+        {
+            const SessionId id = AssignId();
+            SessionPointer pSession = _sessionPool.Acquire(std::move(socket), id, GetLogicShard(id).receiveQueue);
+            Logger::Info("[", pSession->GetId(), "] Session created: ", pSession->GetEndpoint());
 
             bool isDenied = false;
             pSession = OnSessionCreated(std::move(pSession), isDenied);
 
             if (isDenied)
             {
-                std::cout << pSession << " Session denied: " << pSession->GetEndpoint() << "\n";
-                return;   
+                Logger::Info("[", pSession->GetId(), "] Session denied: ", pSession->GetEndpoint());
+                return nullptr;   
             }
 
-            RegisterSessionAsync(std::move(pSession));
+            RegisterSessionAsync(pSession);
+
+            return pSession;
         }
 
         void DestroySessionAsync(SessionPointer pSession)
@@ -98,47 +196,171 @@ namespace NetCommon
             boost::asio::post(_sessionsStrand,
                               [this]()
                               {
-                                  for (auto& sessionPair : _sessions)
-                                  {
-                                      sessionPair.second->CloseAsync();
-                                  }
+                                  _sessions.ForEach([](Session& session)
+                                                    {
+                                                        session.CloseAsync();
+                                                    });
                               });
         }
 
         template<typename TMessage>
-        void SendMessageAsync(SessionPointer pSession, TMessage&& message)
+        void SendMessageAsync(SessionPointer pSession, TMessage&& message, SendOptions options = SendOptions())
         {
             assert(pSession != nullptr);
 
-            pSession->SendMessageAsync(std::forward<TMessage>(message));
+            pSession->SendMessageAsync(std::forward<TMessage>(message), options);
+        }
+
+        // Called from the logic shards, false if the session of the handle is gone
+        template<typename TMessage>
+        bool SendMessageAsync(SessionHandle handle, TMessage&& message, SendOptions options = SendOptions())
+        {
+            Session* pSession = FindSession(handle);
+
+            if (pSession == nullptr)
+            {
+                return false;
+            }
+
+            pSession->SendMessageAsync(std::forward<TMessage>(message), options);
+
+            return true;
         }
 
+        // The message is encoded once and the frame is shared by every session
         template<typename TMessage>
-        void BroadcastMessageAsync(TMessage&& message, SessionPointer pIgnoredSession = nullptr)
+        void BroadcastMessageAsync(TMessage&& message, SessionHandle ignoredHandle = SessionHandle(), SendOptions options = SendOptions())
         {
             boost::asio::post(_sessionsStrand,
                               [this, 
-                              message = std::forward<TMessage>(message), 
-                              pIgnoredSession = std::move(pIgnoredSession)]()
+                              pFrame = Frame::Create(std::forward<TMessage>(message), options), 
+                              ignoredHandle]()
                               {
-                                  for (auto& sessionPair : _sessions)
-                                  {
-                                      if (sessionPair.second != pIgnoredSession)
-                                      {
-                                          sessionPair.second->SendMessageAsync(message);
-                                      }
-                                  }
+                                  _sessions.ForEach([&pFrame, ignoredHandle](Session& session)
+                                                    {
+                                                        if (session.GetHandle() != ignoredHandle)
+                                                        {
+                                                            session.SendFrameAsync(pFrame);
+                                                        }
+                                                    });
                               });
         }
 
+        // Messages over the datagram payload, and all of them until the channel is bound, go over the session in the realtime lane
+        template<typename TMessage>
+        void SendDatagramAsync(SessionPointer pSession, TMessage&& message, DatagramDelivery delivery = DatagramDelivery::UnreliableSequenced)
+        {
+            assert(pSession != nullptr);
+
+            if (_pDatagramEndpoint == nullptr ||
+                pSession->GetDatagramToken() == 0 ||
+                message.payload.size() > _pDatagramEndpoint->GetMaxPayloadSize())
+            {
+                pSession->SendMessageAsync(std::forward<TMessage>(message), SendOptions{SendLane::Realtime});
+                return;
+            }
+
+            _pDatagramEndpoint->SendAsync(std::move(pSession), Message(std::forward<TMessage>(message)), delivery);
+        }
+
+        // Called from the logic shards, false if the session of the handle is gone
+        template<typename TMessage>
+        bool SendDatagramAsync(SessionHandle handle, TMessage&& message, DatagramDelivery delivery = DatagramDelivery::UnreliableSequenced)
+        {
+            Session* pSession = FindSession(handle);
+
+            if (pSession == nullptr)
+            {
+                return false;
+            }
+
+            SendDatagramAsync(pSession->shared_from_this(), std::forward<TMessage>(message), delivery);
+
+            return true;
+        }
+
+        // Lock-free, the session stays valid until the end of the current tick of the calling logic shard
+        // Other threads hold a SessionPointer instead
+        Session* FindSession(SessionHandle handle) const
+        {
+            return _sessions.Find(handle);
+        }
+
+        size_t GetLogicShardCount() const
+        {
+            return _logicShards.size();
+        }
+
+        size_t GetLogicShardIndex(SessionId id) const
+        {
+            return id % _logicShards.size();
+        }
+
+        // Run the task on the update loop of the shard, before its next dispatch
+        void PostToLogicShard(size_t shardIndex, ShardTask task)
+        {
+            assert(shardIndex < _logicShards.size());
+
+            _logicShards[shardIndex]->taskQueue.Push(std::move(task));
+        }
+
+        // Called on the update loop of the shard only, the callback runs on it once the delay has passed, rounded up to the timer resolution
+        // The wheel stands at the start of the current tick, so the delay is counted from now rather than from its tick
+        TimerId ScheduleTimer(size_t shardIndex, Clock::duration delay, TimerCallback callback)
+        {
+            assert(shardIndex < _logicShards.size());
+
+            TimingWheel& timers = _logicShards[shardIndex]->timers;
+            const Clock::duration resolution = _config.timerResolution;
+            const Clock::duration expiryTime = Clock::now() + std::max(delay, Clock::duration::zero()) - _timersStart;
+            const TimingWheel::Tick expiryTick = static_cast<TimingWheel::Tick>((expiryTime + resolution - Clock::duration(1)) / resolution);
+            const TimingWheel::Tick nTicks = (expiryTick > timers.GetCurrentTick()) ? expiryTick - timers.GetCurrentTick() : 0;
+
+            return timers.Schedule(nTicks, std::move(callback));
+        }
+
+        // Called on the update loop of the shard only, false if the timer fired or was cancelled already
+        bool CancelTimer(size_t shardIndex, TimerId timerId)
+        {
+            assert(shardIndex < _logicShards.size());
+
+            return _logicShards[shardIndex]->timers.Cancel(timerId);
+        }
+
+        // Called by the derived constructor, the server issues a token to each session and the client opens a channel per bind it receives
+        void OpenDatagramEndpoint(uint16_t port, bool shouldIssueTokens)
+        {
+            _pDatagramEndpoint = std::make_unique<DatagramEndpoint>(_workers.GetExecutor(),
+                                                                    port,
+                                                                    _config.datagramMtu,
+                                                                    _config.datagramFlushInterval,
+                                                                    _config.datagramResendTimeout,
+                                                                    _metrics);
+            _shouldIssueDatagramTokens = shouldIssueTokens;
+
+            Logger::Info("[DATAGRAM] Bound to port ", _pDatagramEndpoint->GetPort());
+        }
+
     private:
-        SessionId AssignId()
+        void InitLogicShards(size_t nLogicShards)
+        {
+            assert(nLogicShards > 0);
+
+            for (size_t shardIndex = 0; shardIndex < nLogicShards; ++shardIndex)
+            {
+                _logicShards.emplace_back(std::make_unique<LogicShard>(shardIndex, _workers.GetExecutor(shardIndex)));
+            }
+        }
+
+        LogicShard& GetLogicShard(SessionId id)
         {
-            static SessionId id = 10000;
-            SessionId assignedId = id;
-            ++id;
+            return *_logicShards[GetLogicShardIndex(id)];
+        }
 
-            return assignedId;
+        // Called from every acceptor strand
+        SessionId AssignId()
+        {
+            return _nextSessionId.fetch_add(1);
         }
 
         void RegisterSessionAsync(SessionPointer pSession)
@@ -152,81 +374,381 @@ namespace NetCommon
 
         void RegisterSession(SessionPointer pSession)
         {
-            const SessionId id = pSession->GetId();
+            const SessionHandle handle = _sessions.Add(pSession);
+
+            if (!handle.IsValid())
+            {
+                Logger::Error("[", pSession->GetId(), "] Failed to register: no free slot");
+                pSession->CloseAsync();
+                return;
+            }
+
+            _metrics.nActiveSessions.Add(1);
+            _metrics.nOpenedSessions.Add(1);
+            Logger::Info("[", pSession->GetId(), "] Session registered: ", handle);
+
+            if (_pDatagramEndpoint != nullptr &&
+                _shouldIssueDatagramTokens)
+            {
+                pSession->SetDatagramBind(_pDatagramEndpoint->OpenChannelAsync(pSession), _pDatagramEndpoint->GetPort());
+            }
 
-            _sessions[id] = std::move(pSession);
-            std::cout << _sessions[id] << " Session registered\n";
+            OnSessionRegistered(pSession);
+
+            if (_config.idleTimeout.count() > 0 ||
+                _config.heartbeatInterval.count() > 0)
+            {
+                const size_t shardIndex = GetLogicShardIndex(pSession->GetId());
 
-            OnSessionRegistered(_sessions[id]);
+                PostToLogicShard(shardIndex,
+                                 [this, shardIndex, handle]()
+                                 {
+                                     CheckKeepAlive(shardIndex, handle);
+                                 });
+            }
 
-            _sessions[id]->ReceiveMessageAsync();
+            pSession->StartAsync();
+        }
+
+        // One timer per session covers the idle timeout and the heartbeat, it is not rearmed once the session is gone
+        void CheckKeepAlive(size_t shardIndex, SessionHandle handle)
+        {
+            Session* pSession = FindSession(handle);
+
+            if (pSession == nullptr)
+            {
+                return;
+            }
+
+            const TimePoint now = Clock::now();
+            TimePoint nextCheckTime = TimePoint::max();
+
+            if (_config.idleTimeout.count() > 0)
+            {
+                const TimePoint idleTime = pSession->GetLastReceiveTime() + _config.idleTimeout;
+
+                if (now >= idleTime)
+                {
+                    Logger::Info("[", pSession->GetId(), "] Session timed out: idle for ", _config.idleTimeout.count(), "ms");
+                    _metrics.nIdleTimeouts.Add(1);
+
+                    pSession->CloseAsync();
+                    return;
+                }
+
+                nextCheckTime = idleTime;
+            }
+
+            if (_config.heartbeatInterval.count() > 0)
+            {
+                TimePoint heartbeatTime = pSession->GetLastSendTime() + _config.heartbeatInterval;
+
+                if (now >= heartbeatTime)
+                {
+                    pSession->SendHeartbeatAsync();
+                    heartbeatTime = now + _config.heartbeatInterval;
+                }
+
+                nextCheckTime = std::min(nextCheckTime, heartbeatTime);
+            }
+
+            ScheduleTimer(shardIndex,
+                          nextCheckTime - now,
+                          [this, shardIndex, handle]()
+                          {
+                              CheckKeepAlive(shardIndex, handle);
+                          });
+        }
+
+        // Called in the read chain of the session, the channel sends to the bound port on the address of the server
+        void OnDatagramBound(SessionPointer pSession, uint64_t token, uint16_t port)
+        {
+            if (_pDatagramEndpoint == nullptr)
+            {
+                return;
+            }
+
+            const boost::asio::ip::udp::endpoint remoteEndpoint(pSession->GetEndpoint().address(), port);
+            Logger::Info("[", pSession->GetId(), "] Datagram channel bound: ", remoteEndpoint);
+
+            _pDatagramEndpoint->OpenChannelAsync(pSession, token, remoteEndpoint);
         }
 
         void UnregisterSession(SessionPointer pSession)
         {
-            assert(_sessions.count(pSession->GetId()) == 1);
+            const SessionHandle handle = pSession->GetHandle();
 
-            _sessions.erase(pSession->GetId());
-            std::cout << pSession << " Session unregistered\n";
+            // Denied or never registered, the client still reconnects the slot of a session the registry had no room for
+            if (!handle.IsValid())
+            {
+                OnSessionUnregistered(std::move(pSession));
+                return;
+            }
+
+            _sessions.Retire(handle);
+            _metrics.nActiveSessions.Add(-1);
+            _metrics.nClosedSessions.Add(1);
+            Logger::Info("[", pSession->GetId(), "] Session unregistered");
 
             OnSessionUnregistered(std::move(pSession));
+
+            ReleaseSessionAsync(handle);
         }
 
-        void UpdateAsync()
+        // The slot is freed once every logic shard has started a new tick, so no shard still uses what it found by the handle
+        // A stopped shard finds nothing anymore and passes at once, so that its slots do not leak
+        void ReleaseSessionAsync(SessionHandle handle)
         {
-            boost::asio::post(_receiveStrand,
-                              [this]()
+            auto pRelease = std::make_shared<PendingRelease>(handle, _logicShards.size());
+
+            for (size_t shardIndex = 0; shardIndex < _logicShards.size(); ++shardIndex)
+            {
+                PostToLogicShard(shardIndex,
+                                 [this, pRelease, shardIndex]()
+                                 {
+                                     PassRelease(*pRelease, shardIndex);
+                                 });
+
+                // Pairs with the fence of StopShard, either the shard runs the task or the flag is seen here
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                if (_logicShards[shardIndex]->isStopped.load(std::memory_order_relaxed))
+                {
+                    PassRelease(*pRelease, shardIndex);
+                }
+            }
+        }
+
+        void PassRelease(PendingRelease& release, size_t shardIndex)
+        {
+            if (release.hasShardPassed[shardIndex].exchange(true) ||
+                release.nPendingShards.fetch_sub(1) != 1)
+            {
+                return;
+            }
+
+            boost::asio::post(_sessionsStrand,
+                              [this, handle = release.handle]()
                               {
-                                  FetchReceivedMessages();
+                                  _sessions.Release(handle);
                               });
         }
 
-        void FetchReceivedMessages()
+        static Clock::duration CalculateTickInterval(uint32_t tickRate)
         {
-            if (_nMaxReceivedMessages == 0)
+            if (tickRate == 0)
             {
-                _receivedMessages = std::move(_receiveBuffer);
+                return Clock::duration::zero();
             }
-            else
+
+            return std::chrono::duration_cast<Clock::duration>(Seconds(1)) / tickRate;
+        }
+
+        void UpdateAsync(LogicShard& shard)
+        {
+            boost::asio::post(shard.tickTimer.get_executor(),
+                              [this, &shard]()
+                              {
+                                  Update(shard);
+                              });
+        }
+
+        void Update(LogicShard& shard)
+        {
+            const TimePoint tickStart = Clock::now();
+
+            FetchReceivedMessages(shard);
+            RunShardTasks(shard);
+            AdvanceTimers(shard, tickStart);
+            DispatchReceivedMessages(shard, tickStart);
+        }
+
+        void AdvanceTimers(LogicShard& shard, const TimePoint tickStart)
+        {
+            const Clock::duration resolution = _config.timerResolution;
+
+            shard.timers.AdvanceTo(static_cast<TimingWheel::Tick>((tickStart - _timersStart) / resolution));
+        }
+
+        // The update loop of the shard is the only consumer of its queues
+        // Everything received is fetched so that a flooding session does not hold back the messages behind its own,
+        // the inbound quota of the sessions bounds it
+        void FetchReceivedMessages(LogicShard& shard)
+        {
+            OwnedMessage receivedMessage;
+
+            while (shard.receiveQueue.TryPop(receivedMessage))
             {
-                for (size_t messageCount = 0; messageCount < _nMaxReceivedMessages; ++messageCount)
+                OwnedMessageBuffer& messages = shard.inboundMessages[receivedMessage.owner];
+
+                if (messages.empty())
                 {
-                    if (_receiveBuffer.empty())
+                    shard.pendingSessions.push_back(receivedMessage.owner);
+                }
+
+                messages.emplace(std::move(receivedMessage));
+            }
+        }
+
+        void RunShardTasks(LogicShard& shard)
+        {
+            ShardTask task;
+
+            while (shard.taskQueue.TryPop(task))
+            {
+                task();
+            }
+        }
+
+        // Each pending session gets up to nMaxSessionMessages per tick, a session with messages left goes to the back of the ring
+        // Sessions not served when the tick budget runs out are served first on the next tick
+        void DispatchReceivedMessages(LogicShard& shard, const TimePoint tickStart)
+        {
+            const bool hasBudget = (_config.tickBudget.count() > 0);
+            const TimePoint budgetEnd = tickStart + _config.tickBudget;
+            size_t nDispatchedMessages = 0;
+            bool isBudgetExhausted = false;
+
+            for (size_t nPendingSessions = shard.pendingSessions.size(); 
+                 nPendingSessions > 0 && !isBudgetExhausted; 
+                 --nPendingSessions)
+            {
+                const SessionHandle handle = shard.pendingSessions.front();
+                shard.pendingSessions.pop_front();
+
+                auto messagesIterator = shard.inboundMessages.find(handle);
+                OwnedMessageBuffer& messages = messagesIterator->second;
+                size_t nSessionMessages = 0;
+
+                while (!messages.empty() && 
+                       (_config.nMaxSessionMessages == 0 || nSessionMessages < _config.nMaxSessionMessages))
+                {
+                    if ((hasBudget && Clock::now() >= budgetEnd) ||
+                        (_config.nMaxReceivedMessages > 0 && nDispatchedMessages >= _config.nMaxReceivedMessages))
                     {
+                        isBudgetExhausted = true;
                         break;
                     }
 
-                    _receivedMessages.emplace(std::move(_receiveBuffer.front()));
-                    _receiveBuffer.pop();
+                    HandleReceivedMessage(std::move(messages.front()));
+                    messages.pop();
+                    _metrics.receiveQueueDepth.Add(-1);
+                    ++nDispatchedMessages;
+                    ++nSessionMessages;
+                }
+
+                // Messages of a session gone already are dispatched as well, its quota went with it
+                Session* pSession = FindSession(handle);
+
+                if (pSession != nullptr &&
+                    nSessionMessages > 0)
+                {
+                    pSession->ReleaseInboundMessages(nSessionMessages);
+                }
+
+                if (messages.empty())
+                {
+                    shard.inboundMessages.erase(messagesIterator);
+                }
+                else if (isBudgetExhausted)
+                {
+                    shard.pendingSessions.push_front(handle);
+                }
+                else
+                {
+                    shard.pendingSessions.push_back(handle);
                 }
             }
 
-            boost::asio::post([this]()
-                              {
-                                   DispatchReceivedMessages();
-                              });
+            const bool shouldUpdate = OnReceivedMessagesDispatched();
+            _metrics.tickDurations.Record(std::chrono::duration_cast<MicroSeconds>(Clock::now() - tickStart).count());
+
+            OnUpdateCompleted(shard, shouldUpdate);
         }
 
-        void DispatchReceivedMessages()
+        void OnUpdateCompleted(LogicShard& shard, const bool shouldUpdate)
         {
-            while (!_receivedMessages.empty())
+            if (shard.index == 0)
             {
-                HandleReceivedMessage(std::move(_receivedMessages.front()));
-                _receivedMessages.pop();
+                _tickRate.fetch_add(1);
             }
 
-            const bool shouldUpdate = OnReceivedMessagesDispatched();
-            OnUpdateCompleted(shouldUpdate);
+            if (!shouldUpdate)
+            {
+                StopShard(shard);
+                return;
+            }
+
+            if (_tickInterval == Clock::duration::zero())
+            {
+                UpdateAsync(shard);
+                return;
+            }
+
+            ScheduleNextTick(shard);
+        }
+
+        // The tasks queued before the flag is seen run once more, the releases among them pass
+        void StopShard(LogicShard& shard)
+        {
+            shard.isStopped.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            RunShardTasks(shard);
+        }
+
+        void ScheduleNextTick(LogicShard& shard)
+        {
+            const TimePoint now = Clock::now();
+
+            shard.tickDeadline += _tickInterval;
+
+            // Too far behind, skip the missed ticks instead of bursting
+            if (shard.tickDeadline + _tickInterval < now)
+            {
+                shard.tickDeadline = now;
+            }
+
+            WaitTickAsync(shard);
+        }
+
+        // Sleep on the timer until the spin threshold, then spin to the deadline
+        void WaitTickAsync(LogicShard& shard)
+        {
+            const TimePoint sleepEnd = shard.tickDeadline - _config.spinThreshold;
+
+            if (Clock::now() >= sleepEnd)
+            {
+                SpinUntilTick(shard);
+                return;
+            }
+
+            shard.tickTimer.expires_at(sleepEnd);
+            shard.tickTimer.async_wait([this, &shard](const ErrorCode& error)
+                                       {
+                                           OnTickTimerExpired(error, shard);
+                                       });
         }
 
-        void OnUpdateCompleted(const bool shouldUpdate)
+        void OnTickTimerExpired(const ErrorCode& error, LogicShard& shard)
         {
-            _tickRate.fetch_add(1);
+            if (error)
+            {
+                Logger::Error("[TICK_TIMER] Failed to wait: ", error);
+                return;
+            }
 
-            if (shouldUpdate)
+            SpinUntilTick(shard);
+        }
+
+        void SpinUntilTick(LogicShard& shard)
+        {
+            while (Clock::now() < shard.tickDeadline)
             {
-                UpdateAsync();
+                std::this_thread::yield();
             }
+
+            Update(shard);
         }
 
         void WaitTickRateTimerAsync()
@@ -242,7 +764,7 @@ namespace NetCommon
         {
             if (error)
             {
-                std::cerr << "[TICK_RATE_TIMER] Failed to wait: " << error << "\n";
+                Logger::Error("[TICK_RATE_TIMER] Failed to wait: ", error);
                 return;
             }
 
@@ -250,23 +772,75 @@ namespace NetCommon
 
             const TickRate tickRate = _tickRate.exchange(0);
             OnTickRateMeasured(tickRate);
+
+            PublishMetrics(tickRate);
+        }
+
+        void PublishMetrics(const TickRate tickRate)
+        {
+            if (_pStatsEndpoint == nullptr &&
+                _config.statsSnapshotPath.empty())
+            {
+                return;
+            }
+
+            std::string report = _metricsReporter.Report(tickRate);
+
+            if (!_config.statsSnapshotPath.empty())
+            {
+                std::ofstream snapshot(_config.statsSnapshotPath, std::ios::trunc);
+
+                // Logged once until the file opens again, the report is published every second
+                if (!snapshot)
+                {
+                    if (!_hasSnapshotFailed)
+                    {
+                        Logger::Error("[STATS] Failed to write snapshot: ", _config.statsSnapshotPath);
+                        _hasSnapshotFailed = true;
+                    }
+                }
+                else
+                {
+                    snapshot << report;
+                    _hasSnapshotFailed = false;
+                }
+            }
+
+            if (_pStatsEndpoint != nullptr)
+            {
+                _pStatsEndpoint->SetReportAsync(std::move(report));
+            }
         }
 
     protected:
-        ThreadPool                      _workers;
-        WorkGuard                       _workGuard;
-        SessionMap                      _sessions;
+        const ServiceConfig             _config;
+        // Outlives the workers, sessions held by pending handlers update it until they are destroyed
+        ServiceMetrics                  _metrics;
+        Workers                         _workers;
+        // Sessions not yet released when the service stops are dropped with it
+        SessionRegistry                 _sessions;
         Strand                          _sessionsStrand;
+        // Sessions still owned by pending handlers are released after it and deleted
+        SessionPool                     _sessionPool;
+        std::atomic<SessionId>          _nextSessionId;
 
         // Update
         Timer                           _tickRateTimer;
         std::atomic<TickRate>           _tickRate;
+        const Clock::duration           _tickInterval;
+        const TimePoint                 _timersStart;
+
+        // Datagram channels, null unless the derived service opens the endpoint
+        DatagramEndpoint::Pointer       _pDatagramEndpoint;
+        bool                            _shouldIssueDatagramTokens;
 
         // Receive
-        OwnedMessageBuffer              _receiveBuffer;
-        Strand                          _receiveStrand;
-        OwnedMessageBuffer              _receivedMessages;
-        const size_t                    _nMaxReceivedMessages;
+        LogicShard::Vector              _logicShards;
+
+        // Metrics
+        MetricsReporter                 _metricsReporter;
+        std::unique_ptr<StatsEndpoint>  _pStatsEndpoint;
+        bool                            _hasSnapshotFailed;
 
     };
 }
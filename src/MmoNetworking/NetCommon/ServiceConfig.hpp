@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/ControlMessage.hpp>
+#include <NetCommon/Workers.hpp>
+#include <NetCommon/SendQueueLimits.hpp>
+
+namespace NetCommon
+{
+    struct ServiceConfig
+    {
+        using MicroSeconds      = std::chrono::microseconds;
+        using MilliSeconds      = std::chrono::milliseconds;
+
+        size_t          nWorkers                = 4;
+        // IoContextPerCore runs an io_context per worker, a spin before the tick blocks the core
+        ExecutionModel  executionModel          = ExecutionModel::ThreadPool;
+        // Pin the worker of each io_context to a cpu, IoContextPerCore only
+        bool            shouldPinWorkers        = false;
+        // Logic shards, each with its own update loop
+        size_t          nLogicShards            = 1;
+
+        // Update loop: target tick rate in hz, 0 runs the loop back to back
+        uint32_t        tickRate                = 0;
+        // Time the update loop may spend dispatching per tick, 0 is unlimited
+        MicroSeconds    tickBudget              = MicroSeconds(0);
+        // Last part of the wait for the next tick that spins instead of sleeping on a timer
+        // The spin holds a worker that I/O completions queue behind, so it is off unless the workers have cores to spare
+        MicroSeconds    spinThreshold           = MicroSeconds(0);
+        // Messages dispatched per tick by a logic shard, 0 is unlimited
+        size_t          nMaxReceivedMessages    = 0;
+        // Messages of one session dispatched per tick, the sessions are served round-robin, 0 is unlimited
+        size_t          nMaxSessionMessages     = 32;
+        // Messages of one session waiting for dispatch at which it stops reading until half of them are dispatched, 0 is unlimited
+        size_t          nMaxInboundMessages     = 256;
+        // Tick of the timing wheel of each logic shard
+        MilliSeconds    timerResolution         = MilliSeconds(10);
+
+        // Session features this side accepts, the peers use the common ones
+        SessionFeatures sessionFeatures         = 0;
+        // Payloads from this size are compressed when the session has Compression
+        size_t          compressionThreshold    = 512;
+        // Watermarks and slow consumer policy of the send queue of each session
+        SendQueueLimits sendQueueLimits;
+        // Sessions allocated at startup, and the idle sessions kept for reuse, 0 keeps them all
+        size_t          nWarmSessions           = 0;
+        size_t          nMaxPooledSessions      = 0;
+
+        // Slots of the session registry, sessions over it are closed on registration
+        size_t          nMaxSessions            = 65536;
+        // Sessions receiving nothing for this long are closed, 0 disables
+        MilliSeconds    idleTimeout             = MilliSeconds(0);
+        // Sessions sending nothing for this long send a Heartbeat if the peer has the feature, 0 disables
+        MilliSeconds    heartbeatInterval       = MilliSeconds(0);
+
+        // Datagram channels are opened for the sessions granted Datagram
+        // Server: UDP port of the channels, 0 binds an ephemeral one. The client always binds an ephemeral one
+        uint16_t        datagramPort            = 0;
+        // Packet size small messages are packed up to, bigger messages go over the session
+        size_t          datagramMtu             = 1200;
+        // Period of the acks, resends and client address announcements
+        MilliSeconds    datagramFlushInterval   = MilliSeconds(10);
+        // Reliable messages not acked for this long are resent
+        MilliSeconds    datagramResendTimeout   = MilliSeconds(100);
+
+        // Loopback port answering with the metrics as plain text, 0 disables
+        uint16_t        statsPort               = 0;
+        // File overwritten with the metrics every second, empty disables
+        std::string     statsSnapshotPath;
+
+        // Server: listening sockets sharing the port with SO_REUSEPORT, one where it is not supported
+        size_t          nAcceptors              = 1;
+        // Server: accepts kept outstanding on each listening socket
+        size_t          nPendingAccepts         = 1;
+
+        // Client: connects in flight at once
+        size_t          nMaxPendingConnects     = 64;
+        // Client: delay before retrying a failed or dropped connection, doubled per failure up to the max, 0 disables
+        MilliSeconds    reconnectDelay          = MilliSeconds(100);
+        MilliSeconds    maxReconnectDelay       = MilliSeconds(10000);
+    };
+}
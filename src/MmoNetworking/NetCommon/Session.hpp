@@ -2,48 +2,74 @@
 
 #include <NetCommon/Include.hpp>
 #include <NetCommon/Message.hpp>
+#include <NetCommon/Frame.hpp>
+#include <NetCommon/ReadBuffer.hpp>
+#include <NetCommon/ControlMessage.hpp>
+#include <NetCommon/FrameCodec.hpp>
+#include <NetCommon/MessageWriter.hpp>
+#include <NetCommon/MessageReader.hpp>
+#include <NetCommon/Metrics.hpp>
+#include <NetCommon/Logger.hpp>
+#include <NetCommon/Workers.hpp>
+#include <NetCommon/SessionHandle.hpp>
+#include <NetCommon/SendQueueLimits.hpp>
 
 namespace NetCommon
 {
+    // Sessions are recycled by SessionPool, Open and Recycle bracket each connection
     class Session 
         : public std::enable_shared_from_this<Session>
     {
+        friend class SessionPool;
+        friend class SessionRegistry;
+
     public:
         using Pointer               = std::shared_ptr<Session>;
         using Id                    = uint32_t;
-        using OwnedMessage          = OwnedMessage<Session>;
+        using OwnedMessage          = OwnedMessage<SessionHandle>;
         using OwnedMessageBuffer    = OwnedMessage::Buffer;
+        using OwnedMessageQueue     = OwnedMessage::Queue;
+        using CloseCallback         = std::function<void(Pointer)>;
+        using PressureCallback      = std::function<void(Pointer, bool)>;
+        using DatagramBindCallback  = std::function<void(Pointer, uint64_t, uint16_t)>;
 
     private:
-        using ThreadPool            = boost::asio::thread_pool;
-        using Strand                = boost::asio::strand<ThreadPool::executor_type>;
+        using Executor              = Workers::Executor;
         using ErrorCode             = boost::system::error_code;
         using Tcp                   = boost::asio::ip::tcp;
         using Endpoints             = boost::asio::ip::basic_resolver_results<Tcp>;
-        using CloseCallback         = std::function<void(Pointer)>;
-        using MessageBuffer         = Message::Buffer;
+        using Clock                 = std::chrono::steady_clock;
+        using TimePoint             = Clock::time_point;
+        using Timer                 = boost::asio::steady_timer;
+        using FrameBuffer           = std::deque<Frame::Pointer>;
+        using SendLanes             = std::array<FrameBuffer, static_cast<size_t>(SendLane::Count)>;
+        using WriteBuffers          = std::vector<boost::asio::const_buffer>;
 
-    public:
-        ~Session()
+        // Frame in the write batch, a chunked frame has an entry per chunk and only the last one completes it
+        struct WriteFrame
         {
-            std::cout << "[" << _id << "] Session destroyed: " << _endpoint << "\n";
-        }
+            Frame::Pointer  pFrame;
+            bool            isLastPart;
+        };
 
-        static Pointer Create(ThreadPool& workers,
-                              Tcp::socket&& socket,
-                              Id id,
-                              CloseCallback onSessionClosed,
-                              OwnedMessageBuffer& receiveBuffer,
-                              Strand& receiveStrand)
-        {
-            return Pointer(new Session(workers,
-                                       std::move(socket),
-                                       id,
-                                       std::move(onSessionClosed),
-                                       receiveBuffer,
-                                       receiveStrand));
-        }
+        using WriteFrames           = std::vector<WriteFrame>;
+
+        // Caps of a single gather-write
+        static constexpr size_t     MaxWriteBytes       = 64 * 1024;
+        static constexpr size_t     MaxWriteBuffers     = 64;
+        static constexpr size_t     MaxWriteFrames      = MaxWriteBuffers / 2;
+
+        // Bulk payloads over the chunk size are sent in Chunk messages, prefixed by the id and payload size of the whole message
+        static constexpr size_t     BulkChunkSize       = 16 * 1024;
+        static constexpr size_t     ChunkPrefixSize     = sizeof(Message::Id) + sizeof(Message::Size);
+        static constexpr size_t     WriteHeaderSize     = FrameCodec::MaxHeaderSize + ChunkPrefixSize;
+
+        using WriteHeaders          = std::array<std::byte, WriteHeaderSize * MaxWriteFrames>;
+
+        static constexpr size_t     ReadBufferSize      = 64 * 1024;
+        static constexpr size_t     MaxReadMessageSize  = 1024 * 1024;
 
+    public:
         void CloseAsync()
         {
             boost::asio::post(_socketStrand,
@@ -54,19 +80,26 @@ namespace NetCommon
         }
 
         template<typename TMessage>
-        void SendMessageAsync(TMessage&& message)
+        void SendMessageAsync(TMessage&& message, SendOptions options = SendOptions())
+        {
+            SendFrameAsync(Frame::Create(std::forward<TMessage>(message), options));
+        }
+
+        void SendFrameAsync(Frame::Pointer pFrame)
         {
             boost::asio::post(_sendStrand,
                               [pSelf = shared_from_this(), 
-                              message = std::forward<TMessage>(message)]() mutable
+                              pFrame = std::move(pFrame)]() mutable
                               {
-                                  pSelf->PushMessageToSendBuffer(std::move(message));
+                                  pSelf->PushFrameToSendBuffer(std::move(pFrame));
                               });
         }
 
-        void ReceiveMessageAsync()
+        // Negotiate features with the peer and start receiving
+        void StartAsync()
         {
-            ReadMessageAsync();
+            SendControlMessageAsync(ControlMessageId::Hello, _supportedFeatures);
+            ReadMessagesAsync();
         }
 
         Id GetId() const
@@ -74,6 +107,84 @@ namespace NetCommon
             return _id;
         }
 
+        // Assigned on registration, invalid before and once recycled
+        SessionHandle GetHandle() const
+        {
+            return _handle;
+        }
+
+        // Called by the logic shard once it has dispatched messages of the session, reading resumes at half the cap
+        void ReleaseInboundMessages(size_t nMessages)
+        {
+            const size_t nInboundMessages = _nInboundMessages.fetch_sub(nMessages) - nMessages;
+
+            if (nInboundMessages <= _nMaxInboundMessages / 2 &&
+                _isReadPaused.load() &&
+                _isReadPaused.exchange(false))
+            {
+                _metrics.nReadPausedSessions.Add(-1);
+                ReadMessagesAsync();
+            }
+        }
+
+        // Completion of the last read and write, for idle timeouts and heartbeats
+        TimePoint GetLastReceiveTime() const
+        {
+            return TimePoint(Clock::duration(_lastReceiveTime.load(std::memory_order_relaxed)));
+        }
+
+        TimePoint GetLastSendTime() const
+        {
+            return TimePoint(Clock::duration(_lastSendTime.load(std::memory_order_relaxed)));
+        }
+
+        // Dropped if the peer has not been granted heartbeats, it times out on its own idle timeout then
+        void SendHeartbeatAsync()
+        {
+            Message message;
+            message.header.id = static_cast<Message::Id>(ControlMessageId::Heartbeat);
+            message.header.size = static_cast<Message::Size>(message.CalculateSize());
+
+            boost::asio::post(_sendStrand,
+                              [pSelf = shared_from_this(),
+                              pFrame = Frame::Create(std::move(message), SendOptions{SendLane::Realtime})]() mutable
+                              {
+                                  if (HasFeature(pSelf->_writeFeatures, SessionFeature::Heartbeat))
+                                  {
+                                      pSelf->PushFrameToSendBuffer(std::move(pFrame));
+                                  }
+                              });
+        }
+
+        // Server: called before StartAsync, the bind is sent once the peer is granted Datagram
+        void SetDatagramBind(uint64_t token, uint16_t port)
+        {
+            _datagramToken.store(token);
+            _datagramPort = port;
+        }
+
+        // 0 until the datagram channel is bound
+        uint64_t GetDatagramToken() const
+        {
+            return _datagramToken.load();
+        }
+
+        // Called by the datagram endpoint, datagrams share the receive queue and inbound quota of the session
+        // Reading cannot be paused for them, so they are refused while the quota is full and the message is left intact
+        // The channel counts the refused sequenced messages as dropped, refused reliable ones come again
+        bool PushDatagramMessage(Message&& message)
+        {
+            if (_nMaxInboundMessages != 0 &&
+                _nInboundMessages.load() >= _nMaxInboundMessages)
+            {
+                return false;
+            }
+
+            PushReceivedMessage(std::move(message));
+
+            return true;
+        }
+
         const Tcp::endpoint& GetEndpoint() const
         {
             return _endpoint;
@@ -87,23 +198,128 @@ namespace NetCommon
         }
 
     private:
-        Session(ThreadPool& workers,
-                Tcp::socket&& socket,
-                Id id,
-                CloseCallback&& onSessionClosed,
-                OwnedMessageBuffer& receiveBuffer,
-                Strand& receiveStrand)
+        Session(Workers& workers,
+                CloseCallback onSessionClosed,
+                PressureCallback onSendQueuePressure,
+                DatagramBindCallback onDatagramBound,
+                SessionFeatures supportedFeatures,
+                size_t compressionThreshold,
+                const SendQueueLimits& sendQueueLimits,
+                size_t nMaxInboundMessages,
+                ServiceMetrics& metrics)
             : _workers(workers)
-            , _socket(std::move(socket))
-            , _socketStrand(boost::asio::make_strand(workers))
-            , _id(id)
-            , _endpoint(_socket.remote_endpoint())
+            , _socket(workers.GetExecutor())
+            , _id(0)
             , _onSessionClosed(std::move(onSessionClosed))
-            , _receiveBuffer(receiveBuffer)
-            , _receiveStrand(receiveStrand)
-            , _sendStrand(boost::asio::make_strand(workers))
-            , _isWritingMessage(false)
-        {}
+            , _pReceiveQueue(nullptr)
+            , _readBuffer(ReadBufferSize)
+            , _nMaxInboundMessages(nMaxInboundMessages)
+            , _nInboundMessages(0)
+            , _isReadPaused(false)
+            , _lastReceiveTime(0)
+            , _lastSendTime(0)
+            , _onDatagramBound(std::move(onDatagramBound))
+            , _datagramToken(0)
+            , _datagramPort(0)
+            , _chunkedId(0)
+            , _chunkedPayloadSize(0)
+            , _isWritingMessages(false)
+            , _bulkOffset(0)
+            , _sendQueueLimits(sendQueueLimits)
+            , _onSendQueuePressure(std::move(onSendQueuePressure))
+            , _nSendQueueFrames(0)
+            , _nSendQueueBytes(0)
+            , _isUnderPressure(false)
+            , _isOverHighWatermark(false)
+            , _gracePeriodTimer(_socket.get_executor())
+            , _isDisconnecting(false)
+            , _supportedFeatures(supportedFeatures)
+            , _grantedFeatures(0)
+            , _readFeatures(0)
+            , _writeFeatures(0)
+            , _pendingWriteFeatures(0)
+            , _compressionThreshold(compressionThreshold)
+            , _metrics(metrics)
+        {
+            _writeFrames.reserve(MaxWriteFrames);
+            _writeBuffers.reserve(MaxWriteBuffers);
+        }
+
+        // The strands and buffers of the previous connection are reused
+        void Open(Tcp::socket&& socket, Id id, OwnedMessageQueue& receiveQueue)
+        {
+            _socket = std::move(socket);
+            _socketStrand = _workers.RebindSerialExecutor(_socketStrand, _socket.get_executor());
+            _sendStrand = _workers.RebindSerialExecutor(_sendStrand, _socket.get_executor());
+
+            // The timer follows the socket to its core, Recycle has cancelled it
+            if (_gracePeriodTimer.get_executor() != _socket.get_executor())
+            {
+                _gracePeriodTimer = Timer(_socket.get_executor());
+            }
+
+            _id = id;
+            _pReceiveQueue = &receiveQueue;
+
+            // A peer gone already leaves the endpoint empty, the first read fails and closes the session
+            ErrorCode error;
+            _endpoint = _socket.remote_endpoint(error);
+
+            const Clock::rep now = Clock::now().time_since_epoch().count();
+            _lastReceiveTime.store(now, std::memory_order_relaxed);
+            _lastSendTime.store(now, std::memory_order_relaxed);
+        }
+
+        // Called once the last owner is gone, no handler of the session is pending but the grace period wait, which holds it weakly
+        void Recycle()
+        {
+            ErrorCode error;
+            _socket.close(error);
+            _gracePeriodTimer.cancel();
+
+            _metrics.sendQueueDepth.Add(-static_cast<int64_t>(_nSendQueueFrames));
+            _metrics.sendQueueBytes.Add(-static_cast<int64_t>(_nSendQueueBytes));
+
+            if (_isUnderPressure)
+            {
+                _metrics.nPressuredSessions.Add(-1);
+            }
+
+            for (FrameBuffer& frames : _sendLanes)
+            {
+                FrameBuffer().swap(frames);
+            }
+
+            _writeFrames.clear();
+            _writeBuffers.clear();
+            _isWritingMessages = false;
+            _bulkOffset = 0;
+            _nSendQueueFrames = 0;
+            _nSendQueueBytes = 0;
+            _isUnderPressure = false;
+            _isOverHighWatermark = false;
+            _isDisconnecting = false;
+            _readBuffer.Reset(ReadBufferSize);
+            _pReceiveQueue = nullptr;
+            _chunkedPayload.clear();
+            _nInboundMessages = 0;
+
+            if (_isReadPaused.exchange(false))
+            {
+                _metrics.nReadPausedSessions.Add(-1);
+            }
+
+            _handle = SessionHandle();
+            _datagramToken = 0;
+            _datagramPort = 0;
+
+            _grantedFeatures = 0;
+            _readFeatures = 0;
+            _writeFeatures = 0;
+            _pendingWriteFeatures = 0;
+
+            Logger::Debug("[", _id, "] Session recycled: ", _endpoint);
+        }
 
         void Close()
         {
@@ -114,109 +330,403 @@ namespace NetCommon
             }
         }
 
-        template<typename TMessage>
-        void PushMessageToSendBuffer(TMessage&& message)
+        void PushFrameToSendBuffer(Frame::Pointer pFrame)
+        {
+            if (_isDisconnecting)
+            {
+                return;
+            }
+
+            const size_t frameSize = pFrame->GetSize();
+            FrameBuffer& frames = _sendLanes[static_cast<size_t>(pFrame->GetLane())];
+
+            frames.emplace_back(std::move(pFrame));
+            ++_nSendQueueFrames;
+            _nSendQueueBytes += frameSize;
+            _metrics.sendQueueDepth.Add(1);
+            _metrics.sendQueueBytes.Add(frameSize);
+
+            const bool isOverHighWatermark = IsOverHighWatermark();
+
+            if (isOverHighWatermark)
+            {
+                ApplySlowConsumerPolicy(frames);
+            }
+
+            UpdateSendQueuePressure(isOverHighWatermark);
+
+            if (_isDisconnecting)
+            {
+                return;
+            }
+
+            WriteMessagesAsync();
+        }
+
+        bool IsOverHighWatermark() const
+        {
+            return (_sendQueueLimits.nHighWatermarkBytes > 0 && _nSendQueueBytes > _sendQueueLimits.nHighWatermarkBytes) ||
+                   (_sendQueueLimits.nHighWatermarkMessages > 0 && _nSendQueueFrames > _sendQueueLimits.nHighWatermarkMessages);
+        }
+
+        bool IsUnderLowWatermark() const
+        {
+            return (_sendQueueLimits.nLowWatermarkBytes == 0 || _nSendQueueBytes <= _sendQueueLimits.nLowWatermarkBytes) &&
+                   (_sendQueueLimits.nLowWatermarkMessages == 0 || _nSendQueueFrames <= _sendQueueLimits.nLowWatermarkMessages);
+        }
+
+        // Frames being written and a bulk frame partly written are never dropped, DropOldest starts from the lowest lane
+        void ApplySlowConsumerPolicy(FrameBuffer& pushedFrames)
+        {
+            switch (_sendQueueLimits.policy)
+            {
+            case SlowConsumerPolicy::DropOldest:
+                for (auto lanesIterator = _sendLanes.rbegin(); lanesIterator != _sendLanes.rend(); ++lanesIterator)
+                {
+                    FrameBuffer& frames = *lanesIterator;
+                    auto frameIterator = frames.begin();
+
+                    if (&frames == &GetBulkLane() && 
+                        _bulkOffset > 0)
+                    {
+                        ++frameIterator;
+                    }
+
+                    while (frameIterator != frames.end() && IsOverHighWatermark())
+                    {
+                        frameIterator = (*frameIterator)->IsDroppable() ? DropFrame(frames, frameIterator) : std::next(frameIterator);
+                    }
+                }
+                break;
+
+            // A bulk frame partly sent in chunks stays at the front of its lane, so the pushed frame is never that one
+            case SlowConsumerPolicy::DropNewest:
+                if (pushedFrames.back()->IsDroppable())
+                {
+                    DropFrame(pushedFrames, std::prev(pushedFrames.end()));
+                }
+                break;
+
+            case SlowConsumerPolicy::Disconnect:
+                break;
+            }
+        }
+
+        FrameBuffer::iterator DropFrame(FrameBuffer& frames, FrameBuffer::iterator frameIterator)
         {
-            _sendBuffer.emplace(std::forward<TMessage>(message));
+            const size_t frameSize = (*frameIterator)->GetSize();
+
+            --_nSendQueueFrames;
+            _nSendQueueBytes -= frameSize;
+            _metrics.sendQueueDepth.Add(-1);
+            _metrics.sendQueueBytes.Add(-static_cast<int64_t>(frameSize));
+            _metrics.nDroppedFrames.Add(1);
 
-            WriteMessageAsync();
+            return frames.erase(frameIterator);
+        }
+
+        FrameBuffer& GetBulkLane()
+        {
+            return _sendLanes[static_cast<size_t>(SendLane::Bulk)];
         }
 
-        void WriteMessageAsync()
+        // Pressure starts when a push goes over a high watermark, before the policy drops anything, and ends under the low watermarks
+        // The grace period starts when the queue stays over a high watermark after the policy and runs until it is under the low watermarks
+        void UpdateSendQueuePressure(const bool isOverHighWatermark)
         {
-            if (_isWritingMessage ||
-                _sendBuffer.empty())
+            if (IsOverHighWatermark())
+            {
+                const TimePoint now = Clock::now();
+
+                if (!_isOverHighWatermark)
+                {
+                    _isOverHighWatermark = true;
+                    _overHighWatermarkTime = now;
+                    WaitGracePeriodAsync();
+                }
+
+                if (now - _overHighWatermarkTime >= _sendQueueLimits.gracePeriod)
+                {
+                    DisconnectSlowConsumer();
+                    return;
+                }
+            }
+            else if (_isOverHighWatermark &&
+                     IsUnderLowWatermark())
+            {
+                _isOverHighWatermark = false;
+                _gracePeriodTimer.cancel();
+            }
+
+            if (!_isUnderPressure &&
+                isOverHighWatermark)
+            {
+                _isUnderPressure = true;
+                _metrics.nPressuredSessions.Add(1);
+                Logger::Warning("[", _id, "] Send queue over the high watermark: ", _nSendQueueBytes, "B, ", _nSendQueueFrames, " messages");
+
+                _onSendQueuePressure(shared_from_this(), true);
+            }
+            else if (_isUnderPressure &&
+                     IsUnderLowWatermark())
+            {
+                _isUnderPressure = false;
+                _metrics.nPressuredSessions.Add(-1);
+                Logger::Info("[", _id, "] Send queue under the low watermark");
+
+                _onSendQueuePressure(shared_from_this(), false);
+            }
+        }
+
+        // A peer that stops reading sends no write completion and may get no more pushes, so the grace period ends on a timer
+        void WaitGracePeriodAsync()
+        {
+            if (_sendQueueLimits.gracePeriod.count() <= 0)
+            {
+                return;
+            }
+
+            _gracePeriodTimer.expires_after(_sendQueueLimits.gracePeriod);
+            _gracePeriodTimer.async_wait(boost::asio::bind_executor(_sendStrand,
+                                                                    [pWeakSelf = weak_from_this()](const ErrorCode& error)
+                                                                    {
+                                                                        Pointer pSelf = pWeakSelf.lock();
+
+                                                                        if (error || pSelf == nullptr)
+                                                                        {
+                                                                            return;
+                                                                        }
+
+                                                                        pSelf->OnGracePeriodExpired();
+                                                                    }));
+        }
+
+        // The wait may have completed before a drop under the low watermarks cancelled it
+        void OnGracePeriodExpired()
+        {
+            if (_isDisconnecting ||
+                !_isOverHighWatermark ||
+                Clock::now() - _overHighWatermarkTime < _sendQueueLimits.gracePeriod)
             {
                 return;
             }
 
-            _writeMessage = std::move(_sendBuffer.front());
-            _sendBuffer.pop();
+            DisconnectSlowConsumer();
+        }
+
+        // The queued frames are released at once, the session stops taking new ones until it is recycled
+        void DisconnectSlowConsumer()
+        {
+            Logger::Warning("[", _id, "] Slow consumer disconnected: ", _nSendQueueBytes, "B, ", _nSendQueueFrames, " messages");
+
+            size_t nReleasedFrames = 0;
+            size_t nReleasedBytes = 0;
+
+            for (FrameBuffer& frames : _sendLanes)
+            {
+                for (const Frame::Pointer& pFrame : frames)
+                {
+                    nReleasedBytes += pFrame->GetSize();
+                }
+
+                nReleasedFrames += frames.size();
+                FrameBuffer().swap(frames);
+            }
+
+            _bulkOffset = 0;
+            _nSendQueueFrames -= nReleasedFrames;
+            _nSendQueueBytes -= nReleasedBytes;
+            _metrics.sendQueueDepth.Add(-static_cast<int64_t>(nReleasedFrames));
+            _metrics.sendQueueBytes.Add(-static_cast<int64_t>(nReleasedBytes));
+            _metrics.nSlowConsumerDisconnects.Add(1);
+
+            _isDisconnecting = true;
+            _gracePeriodTimer.cancel();
+
+            CloseAsync();
+        }
+
+        void WriteMessagesAsync()
+        {
+            if (_isWritingMessages ||
+                _nSendQueueFrames == 0)
+            {
+                return;
+            }
+
+            GatherWriteMessages();
 
             boost::asio::post(_socketStrand,
                               [pSelf = shared_from_this()]()
                               {
-                                  pSelf->WriteHeaderAsync();
+                                  pSelf->WriteBuffersAsync();
                               });
 
-            _isWritingMessage = true;
+            _isWritingMessages = true;
         }
 
-        void WriteHeaderAsync()
+        // Move pending frames to the write batch lane by lane until a cap is reached, at least one frame or chunk
+        // A lower lane is gathered only once the higher ones are empty, so the batch never puts a frame ahead of a higher one
+        void GatherWriteMessages()
         {
-            boost::asio::async_write(_socket,
-                                     boost::asio::buffer(&_writeMessage.header,
-                                                         sizeof(Message::Header)),
-                                     [pSelf = shared_from_this()](const ErrorCode& error,
-                                                                  const size_t nBytesTransferred)
-                                     {
-                                         pSelf->OnWriteHeaderCompleted(error, nBytesTransferred);
-                                     });
+            size_t nWriteBytes = 0;
+
+            for (FrameBuffer& frames : _sendLanes)
+            {
+                while (!frames.empty())
+                {
+                    if (_writeFrames.size() >= MaxWriteFrames ||
+                        !GatherWriteMessage(frames, nWriteBytes))
+                    {
+                        return;
+                    }
+                }
+            }
         }
 
-        void OnWriteHeaderCompleted(const ErrorCode& error, const size_t nBytesTransferred)
+        // Headers are encoded per session since the framing is negotiated per session
+        // False if the next frame or chunk does not fit the batch
+        bool GatherWriteMessage(FrameBuffer& frames, size_t& nWriteBytes)
         {
-            if (error)
+            const Frame& frame = *frames.front();
+
+            Message::Header header = frame.GetHeader();
+            const Message::Payload* pPayload = &frame.GetPayload();
+            bool isCompressed = false;
+
+            if (HasFeature(_writeFeatures, SessionFeature::Compression) &&
+                pPayload->size() >= _compressionThreshold &&
+                !frame.GetCompressedPayload().empty())
+            {
+                pPayload = &frame.GetCompressedPayload();
+                header.size = static_cast<Message::Size>(sizeof(Message::Header) + pPayload->size());
+                isCompressed = true;
+            }
+
+            const bool isChunked = frame.GetLane() == SendLane::Bulk &&
+                                   HasFeature(_writeFeatures, SessionFeature::Chunking) &&
+                                   pPayload->size() > BulkChunkSize;
+            const size_t offset = isChunked ? _bulkOffset : 0;
+            const size_t size = isChunked ? std::min(BulkChunkSize, pPayload->size() - offset) : pPayload->size();
+            const size_t writeSize = sizeof(Message::Header) + (isChunked ? ChunkPrefixSize : 0) + size;
+
+            if (!_writeFrames.empty() &&
+                nWriteBytes + writeSize > MaxWriteBytes)
             {
-                std::cerr << "[" << _id << "] Failed to write header: " << error << "\n";
+                return false;
+            }
+
+            nWriteBytes += writeSize;
+
+            std::byte* pHeader = _writeHeaders.data() + _writeFrames.size() * WriteHeaderSize;
+            size_t headerSize = 0;
+
+            if (!isChunked)
+            {
+                headerSize = FrameCodec::EncodeHeader(_writeFeatures, header, isCompressed, pHeader);
             }
             else
             {
-                assert(sizeof(Message::Header) == nBytesTransferred);
+                Message::Header chunkHeader;
+                chunkHeader.id = static_cast<Message::Id>(ControlMessageId::Chunk);
+                chunkHeader.size = static_cast<Message::Size>(sizeof(Message::Header) + ChunkPrefixSize + size);
 
-                // The size of payload is bigger than 0
-                if (_writeMessage.header.size > sizeof(Message::Header))
-                {
-                    boost::asio::post(_socketStrand,
-                                      [pSelf = shared_from_this()]()
-                                      {
-                                          pSelf->WritePayloadAsync();
-                                      });
+                const Message::Id id = header.id | (isCompressed ? FrameCodec::CompressedIdFlag : 0);
+                const Message::Size payloadSize = static_cast<Message::Size>(pPayload->size());
 
-                    return;
-                }
+                headerSize = FrameCodec::EncodeHeader(_writeFeatures, chunkHeader, false, pHeader);
+                std::memcpy(pHeader + headerSize, &id, sizeof(id));
+                std::memcpy(pHeader + headerSize + sizeof(id), &payloadSize, sizeof(payloadSize));
+                headerSize += ChunkPrefixSize;
             }
 
-            boost::asio::post(_sendStrand,
-                              [pSelf = shared_from_this(), error]
-                              {
-                                  pSelf->OnWriteMessageCompleted(error);
-                              });
+            _writeBuffers.emplace_back(boost::asio::buffer(pHeader, headerSize));
+
+            if (size > 0)
+            {
+                _writeBuffers.emplace_back(boost::asio::buffer(pPayload->data() + offset, size));
+            }
+
+            if (frame.GetHeader().id == static_cast<Message::Id>(ControlMessageId::HelloAck))
+            {
+                _writeFeatures = _pendingWriteFeatures;
+            }
+
+            const bool isLastPart = (offset + size == pPayload->size());
+
+            if (!isLastPart)
+            {
+                _bulkOffset = offset + size;
+                _writeFrames.push_back(WriteFrame{frames.front(), false});
+
+                return true;
+            }
+
+            _bulkOffset = 0;
+            _writeFrames.push_back(WriteFrame{std::move(frames.front()), true});
+            frames.pop_front();
+
+            return true;
         }
 
-        void WritePayloadAsync()
+        void WriteBuffersAsync()
         {
             boost::asio::async_write(_socket,
-                                     boost::asio::buffer(_writeMessage.payload.data(),
-                                                         _writeMessage.payload.size()),
+                                     _writeBuffers,
                                      [pSelf = shared_from_this()](const ErrorCode& error,
                                                                   const size_t nBytesTransferred)
                                      {
-                                         pSelf->OnWritePayloadCompleted(error, nBytesTransferred);
+                                         pSelf->OnWriteBuffersCompleted(error, nBytesTransferred);
                                      });
         }
 
-        void OnWritePayloadCompleted(const ErrorCode& error, const size_t nBytesTransferred)
+        void OnWriteBuffersCompleted(const ErrorCode& error, const size_t nBytesTransferred)
         {
             if (error)
             {
-                std::cerr << "[" << _id << "] Failed to write payload: " << error << "\n";
+                Logger::Error("[", _id, "] Failed to write messages: ", error);
             }
             else
             {
-                assert(nBytesTransferred == _writeMessage.payload.size());
+                assert(nBytesTransferred == boost::asio::buffer_size(_writeBuffers));
             }
 
             boost::asio::post(_sendStrand,
                               [pSelf = shared_from_this(), error]
                               {
-                                  pSelf->OnWriteMessageCompleted(error);
+                                  pSelf->OnWriteMessagesCompleted(error);
                               });
         }
 
-        void OnWriteMessageCompleted(const ErrorCode& error)
+        void OnWriteMessagesCompleted(const ErrorCode& error)
         {
-            _isWritingMessage = false;
+            size_t nWrittenFrames = 0;
+            size_t nWrittenBytes = 0;
+
+            for (const WriteFrame& writeFrame : _writeFrames)
+            {
+                if (writeFrame.isLastPart)
+                {
+                    ++nWrittenFrames;
+                    nWrittenBytes += writeFrame.pFrame->GetSize();
+                }
+            }
+
+            _nSendQueueFrames -= nWrittenFrames;
+            _nSendQueueBytes -= nWrittenBytes;
+            _metrics.sendQueueDepth.Add(-static_cast<int64_t>(nWrittenFrames));
+            _metrics.sendQueueBytes.Add(-static_cast<int64_t>(nWrittenBytes));
+
+            if (!error)
+            {
+                _metrics.nMessagesSent.Add(nWrittenFrames);
+                _metrics.nBytesSent.Add(boost::asio::buffer_size(_writeBuffers));
+                _lastSendTime.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            }
+
+            _writeFrames.clear();
+            _writeBuffers.clear();
+            _isWritingMessages = false;
 
             if (error)
             {
@@ -224,127 +734,408 @@ namespace NetCommon
                 return;
             }
 
-            WriteMessageAsync();
+            UpdateSendQueuePressure(false);
+            WriteMessagesAsync();
         }
 
-        void ReadMessageAsync()
+        void ReadMessagesAsync()
         {
             boost::asio::post(_socketStrand,
                               [pSelf = shared_from_this()]()
                               {
-                                  pSelf->ReadHeaderAsync();
+                                  pSelf->ReadSomeAsync();
                               });
         }
 
-        void ReadHeaderAsync()
+        void ReadSomeAsync()
         {
-            boost::asio::async_read(_socket,
-                                    boost::asio::buffer(&_readMessage.header,
-                                                        sizeof(Message::Header)),
+            _socket.async_read_some(_readBuffer.Prepare(),
                                     [pSelf = shared_from_this()](const ErrorCode& error,
                                                                  const size_t nBytesTransferred)
                                     {
-                                        pSelf->OnReadHeaderCompleted(error, nBytesTransferred);
+                                        pSelf->OnReadSomeCompleted(error, nBytesTransferred);
                                     });
         }
 
-        void OnReadHeaderCompleted(const ErrorCode& error, const size_t nBytesTransferred)
+        void OnReadSomeCompleted(const ErrorCode& error, const size_t nBytesTransferred)
         {
             if (error)
             {
-                std::cerr << "[" << _id << "] Failed to read header: " << error << "\n";
+                Logger::Error("[", _id, "] Failed to read: ", error);
+                CloseAsync();
+                return;
             }
-            else
+
+            _readBuffer.Commit(nBytesTransferred);
+            _metrics.nBytesReceived.Add(nBytesTransferred);
+            _lastReceiveTime.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+
+            if (!ParseMessages())
+            {
+                Logger::Error("[", _id, "] Failed to parse: invalid message");
+                CloseAsync();
+                return;
+            }
+
+            if (TryPauseReading())
             {
-                assert(nBytesTransferred == sizeof(Message::Header));
-                assert(_readMessage.header.size >= sizeof(Message::Header));
+                return;
+            }
+
+            ReadMessagesAsync();
+        }
+
+        // The peer is held back by TCP while the logic shard has nMaxInboundMessages of the session to dispatch
+        bool TryPauseReading()
+        {
+            if (_nMaxInboundMessages == 0 ||
+                _nInboundMessages.load() < _nMaxInboundMessages)
+            {
+                return false;
+            }
 
-                // The size of payload is bigger than 0
-                if (_readMessage.header.size > sizeof(Message::Header))
+            _isReadPaused.store(true);
+            _metrics.nReadPausedSessions.Add(1);
+
+            // The shard may have released the messages before it could see the pause, or resumed reading already
+            if (_nInboundMessages.load() > _nMaxInboundMessages / 2 ||
+                !_isReadPaused.exchange(false))
+            {
+                return true;
+            }
+
+            _metrics.nReadPausedSessions.Add(-1);
+
+            return false;
+        }
+
+        // Push every complete frame in the read buffer to the receive queue, partial frame is left for the next read
+        bool ParseMessages()
+        {
+            while (_readBuffer.GetSize() > 0)
+            {
+                Message message;
+                bool isCompressed = false;
+                size_t headerSize = 0;
+
+                const FrameCodec::Result result = FrameCodec::DecodeHeader(_readFeatures,
+                                                                           _readBuffer.GetData(),
+                                                                           _readBuffer.GetSize(),
+                                                                           message.header,
+                                                                           isCompressed,
+                                                                           headerSize);
+
+                if (result == FrameCodec::Result::Invalid ||
+                    message.header.size > MaxReadMessageSize)
                 {
-                    _readMessage.payload.resize(_readMessage.header.size - sizeof(Message::Header));
+                    return false;
+                }
 
-                    boost::asio::post(_socketStrand,
-                                      [pSelf = shared_from_this()]()
-                                      {
-                                          pSelf->ReadPayloadAsync();
-                                      });
+                if (result == FrameCodec::Result::Incomplete)
+                {
+                    break;
+                }
 
-                    return;
+                const size_t payloadSize = message.header.size - sizeof(Message::Header);
+                const size_t frameSize = headerSize + payloadSize;
+
+                if (_readBuffer.GetSize() < frameSize)
+                {
+                    _readBuffer.Reserve(frameSize);
+                    break;
+                }
+
+                const std::byte* pPayload = _readBuffer.GetData() + headerSize;
+
+                if (!isCompressed)
+                {
+                    message.payload.assign(pPayload, pPayload + payloadSize);
                 }
+                else
+                {
+                    if (!HasFeature(_readFeatures, SessionFeature::Compression) ||
+                        !FrameCodec::DecompressPayload(pPayload, 
+                                                       payloadSize, 
+                                                       MaxReadMessageSize - sizeof(Message::Header), 
+                                                       message.payload))
+                    {
+                        return false;
+                    }
+
+                    message.header.size = static_cast<Message::Size>(message.CalculateSize());
+                }
+
+                _readBuffer.Consume(frameSize);
+
+                if (IsControlMessage(message.header.id))
+                {
+                    if (!HandleControlMessage(message))
+                    {
+                        return false;
+                    }
+
+                    continue;
+                }
+
+                PushReceivedMessage(std::move(message));
             }
 
-            OnReadMessageCompleted(error);
+            return true;
         }
 
-        void ReadPayloadAsync()
+        void PushReceivedMessage(Message&& message)
         {
-            boost::asio::async_read(_socket,
-                                    boost::asio::buffer(_readMessage.payload.data(),
-                                                        _readMessage.payload.size()),
-                                    [pSelf = shared_from_this()](const ErrorCode& error,
-                                                                 const size_t nBytesTransferred)
-                                    {
-                                        pSelf->OnReadPayloadCompleted(error, nBytesTransferred);
-                                    });
+            _pReceiveQueue->Emplace(OwnedMessage{_handle, std::move(message)});
+            _nInboundMessages.fetch_add(1);
+            _metrics.nMessagesReceived.Add(1);
+            _metrics.receiveQueueDepth.Add(1);
         }
 
-        void OnReadPayloadCompleted(const ErrorCode& error, const size_t nBytesTransferred)
+        // Called in the read chain, read features switch right after the HelloAck of the peer
+        bool HandleControlMessage(const Message& message)
         {
-            if (error)
+            MessageReader reader(message);
+            SessionFeatures features = 0;
+
+            switch (static_cast<ControlMessageId>(message.header.id))
             {
-                std::cerr << "[" << _id << "] Failed to read payload: " << error << "\n";
+            case ControlMessageId::Hello:
+                if (!reader.Read(features))
+                {
+                    return false;
+                }
+
+                _grantedFeatures = features & _supportedFeatures;
+                SendControlMessageAsync(ControlMessageId::HelloAck, _grantedFeatures);
+
+                if (HasFeature(_grantedFeatures, SessionFeature::Datagram) &&
+                    _datagramToken.load() != 0)
+                {
+                    SendDatagramBindAsync();
+                }
+
+                return true;
+
+            case ControlMessageId::HelloAck:
+                _readFeatures = _grantedFeatures;
+                return true;
+
+            case ControlMessageId::Chunk:
+                return HasFeature(_readFeatures, SessionFeature::Chunking) && 
+                       HandleChunk(message);
+
+            case ControlMessageId::Heartbeat:
+                return HasFeature(_readFeatures, SessionFeature::Heartbeat);
+
+            case ControlMessageId::DatagramBind:
+                return HasFeature(_readFeatures, SessionFeature::Datagram) &&
+                       HandleDatagramBind(reader);
+
+            default:
+                return false;
             }
-            else
+        }
+
+        // Client: the channel is opened once, to the port on the address of the server
+        bool HandleDatagramBind(MessageReader& reader)
+        {
+            uint64_t token = 0;
+            uint16_t port = 0;
+
+            if (!reader.Read(token) ||
+                !reader.Read(port) ||
+                token == 0 ||
+                port == 0 ||
+                _datagramToken.load() != 0)
             {
-                assert(_readMessage.payload.size() == nBytesTransferred);
+                return false;
             }
 
-            OnReadMessageCompleted(error);
+            _datagramToken.store(token);
+            _datagramPort = port;
+            _onDatagramBound(shared_from_this(), token, port);
+
+            return true;
         }
 
-        void OnReadMessageCompleted(const ErrorCode& error)
+        // The chunks of one message arrive back to back, the message is pushed once its payload is complete
+        bool HandleChunk(const Message& message)
         {
-            if (error)
+            Message::Id id = 0;
+            Message::Size payloadSize = 0;
+
+            if (message.payload.size() <= ChunkPrefixSize)
             {
-                CloseAsync();
-                return;
+                return false;
             }
 
-            boost::asio::post(_receiveStrand,
-                              [pSelf = shared_from_this()]
-                              {
-                                  pSelf->PushMessageToReceiveBuffer();
-                              });
+            std::memcpy(&id, message.payload.data(), sizeof(id));
+            std::memcpy(&payloadSize, message.payload.data() + sizeof(id), sizeof(payloadSize));
+
+            const std::byte* pData = message.payload.data() + ChunkPrefixSize;
+            const size_t size = message.payload.size() - ChunkPrefixSize;
+
+            if (_chunkedPayload.size() == 0)
+            {
+                if (payloadSize > MaxReadMessageSize - sizeof(Message::Header))
+                {
+                    return false;
+                }
+
+                _chunkedId = id;
+                _chunkedPayloadSize = payloadSize;
+                _chunkedPayload.reserve(payloadSize);
+            }
+            else if (id != _chunkedId ||
+                     payloadSize != _chunkedPayloadSize)
+            {
+                return false;
+            }
+
+            const size_t offset = _chunkedPayload.size();
+
+            if (offset + size > _chunkedPayloadSize)
+            {
+                return false;
+            }
+
+            _chunkedPayload.resize(offset + size);
+            std::memcpy(_chunkedPayload.data() + offset, pData, size);
+
+            if (_chunkedPayload.size() < _chunkedPayloadSize)
+            {
+                return true;
+            }
+
+            Message chunkedMessage;
+            chunkedMessage.header.id = _chunkedId & ~FrameCodec::CompressedIdFlag;
+
+            if ((_chunkedId & FrameCodec::CompressedIdFlag) == 0)
+            {
+                chunkedMessage.payload = std::move(_chunkedPayload);
+            }
+            else if (!HasFeature(_readFeatures, SessionFeature::Compression) ||
+                     !FrameCodec::DecompressPayload(_chunkedPayload.data(), 
+                                                    _chunkedPayload.size(), 
+                                                    MaxReadMessageSize - sizeof(Message::Header), 
+                                                    chunkedMessage.payload))
+            {
+                return false;
+            }
+
+            _chunkedPayload.clear();
+            chunkedMessage.header.size = static_cast<Message::Size>(chunkedMessage.CalculateSize());
+
+            if (IsControlMessage(chunkedMessage.header.id))
+            {
+                return false;
+            }
+
+            PushReceivedMessage(std::move(chunkedMessage));
+
+            return true;
         }
 
-        void PushMessageToReceiveBuffer()
+        // Follows the HelloAck in the realtime lane, so the peer reads it with the granted features
+        void SendDatagramBindAsync()
         {
-            _receiveBuffer.push(OwnedMessage{shared_from_this(), std::move(_readMessage)});
+            Message message;
+            message.header.id = static_cast<Message::Id>(ControlMessageId::DatagramBind);
+
+            MessageWriter(message) << _datagramToken.load() << _datagramPort;
 
-            ReadMessageAsync();
+            SendMessageAsync(std::move(message), SendOptions{SendLane::Realtime});
+        }
+
+        // Control messages go in the realtime lane, HelloAck switches the write features once it is encoded
+        void SendControlMessageAsync(ControlMessageId id, SessionFeatures features)
+        {
+            Message message;
+            message.header.id = static_cast<Message::Id>(id);
+
+            MessageWriter(message) << features;
+
+            boost::asio::post(_sendStrand,
+                              [pSelf = shared_from_this(),
+                              pFrame = Frame::Create(std::move(message), SendOptions{SendLane::Realtime}),
+                              id,
+                              features]() mutable
+                              {
+                                  if (id == ControlMessageId::HelloAck)
+                                  {
+                                      pSelf->_pendingWriteFeatures = features;
+                                  }
+
+                                  pSelf->PushFrameToSendBuffer(std::move(pFrame));
+                              });
         }
 
     private:
-        ThreadPool&                     _workers;
+        Workers&                        _workers;
+
+        // Strands in the ThreadPool model, both are the core of the socket in the IoContextPerCore model
         Tcp::socket                     _socket;
-        Strand                          _socketStrand;
-        const Id                        _id;
-        const Tcp::endpoint             _endpoint;
+        Executor                        _socketStrand;
+        Id                              _id;
+        SessionHandle                   _handle;
+        Tcp::endpoint                   _endpoint;
 
         // Unregister-Destroy
         CloseCallback                   _onSessionClosed;
 
         // Receive
-        OwnedMessageBuffer&             _receiveBuffer;
-        Strand&                         _receiveStrand;
-        Message                         _readMessage;
-
-        // Send
-        MessageBuffer                   _sendBuffer;
-        Strand                          _sendStrand;
-        Message                         _writeMessage;
-        bool                            _isWritingMessage;
+        OwnedMessageQueue*              _pReceiveQueue;
+        ReadBuffer                      _readBuffer;
+
+        // Inbound quota, messages pushed to the receive queue and not dispatched yet
+        const size_t                    _nMaxInboundMessages;
+        std::atomic<size_t>             _nInboundMessages;
+        std::atomic<bool>               _isReadPaused;
+
+        // Clock::rep of the last completed read and write, read by the keepalive timer on the logic shard
+        std::atomic<Clock::rep>         _lastReceiveTime;
+        std::atomic<Clock::rep>         _lastSendTime;
+
+        // Datagram channel, set before StartAsync on the server and by the read chain on the client
+        DatagramBindCallback            _onDatagramBound;
+        std::atomic<uint64_t>           _datagramToken;
+        uint16_t                        _datagramPort;
+
+        // Reassembly of the bulk message being received in chunks
+        Message::Id                     _chunkedId;
+        Message::Payload                _chunkedPayload;
+        size_t                          _chunkedPayloadSize;
+
+        // Send, _bulkOffset is the part of the first bulk frame already gathered when it is chunked
+        SendLanes                       _sendLanes;
+        Executor                        _sendStrand;
+        WriteFrames                     _writeFrames;
+        WriteHeaders                    _writeHeaders;
+        WriteBuffers                    _writeBuffers;
+        bool                            _isWritingMessages;
+        size_t                          _bulkOffset;
+
+        // Backpressure, touched only on _sendStrand
+        const SendQueueLimits           _sendQueueLimits;
+        PressureCallback                _onSendQueuePressure;
+        size_t                          _nSendQueueFrames;
+        size_t                          _nSendQueueBytes;
+        bool                            _isUnderPressure;
+        bool                            _isOverHighWatermark;
+        TimePoint                       _overHighWatermarkTime;
+        Timer                           _gracePeriodTimer;
+        bool                            _isDisconnecting;
+
+        // Features, read ones are touched only by the read chain and write ones only on _sendStrand
+        const SessionFeatures           _supportedFeatures;
+        SessionFeatures                 _grantedFeatures;
+        SessionFeatures                 _readFeatures;
+        SessionFeatures                 _writeFeatures;
+        SessionFeatures                 _pendingWriteFeatures;
+        const size_t                    _compressionThreshold;
+
+        // Owned by the service
+        ServiceMetrics&                 _metrics;
 
     };
 }
@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+
+namespace NetCommon
+{
+    // Generational reference to a registered session, stale once the slot of the session is reused
+    // The slot index is in the low half and the generation of the slot in the high half, 0 is never valid
+    class SessionHandle
+    {
+    public:
+        using Value     = uint64_t;
+
+        constexpr SessionHandle()
+            : _value(0)
+        {}
+
+        constexpr SessionHandle(uint32_t index, uint32_t generation)
+            : _value((static_cast<Value>(generation) << 32) | index)
+        {}
+
+        static constexpr SessionHandle FromValue(Value value)
+        {
+            SessionHandle handle;
+            handle._value = value;
+
+            return handle;
+        }
+
+        constexpr uint32_t GetIndex() const
+        {
+            return static_cast<uint32_t>(_value);
+        }
+
+        constexpr uint32_t GetGeneration() const
+        {
+            return static_cast<uint32_t>(_value >> 32);
+        }
+
+        constexpr Value GetValue() const
+        {
+            return _value;
+        }
+
+        constexpr bool IsValid() const
+        {
+            return _value != 0;
+        }
+
+        constexpr bool operator==(const SessionHandle& other) const
+        {
+            return _value == other._value;
+        }
+
+        constexpr bool operator!=(const SessionHandle& other) const
+        {
+            return _value != other._value;
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const SessionHandle& handle)
+        {
+            os << handle.GetIndex() << ":" << handle.GetGeneration();
+
+            return os;
+        }
+
+    private:
+        Value   _value;
+
+    };
+}
+
+namespace std
+{
+    template<>
+    struct hash<NetCommon::SessionHandle>
+    {
+        size_t operator()(const NetCommon::SessionHandle& handle) const
+        {
+            return hash<NetCommon::SessionHandle::Value>()(handle.GetValue());
+        }
+    };
+}
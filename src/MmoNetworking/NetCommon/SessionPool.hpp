@@ -0,0 +1,183 @@
+﻿#pragma once
+
+#include <NetCommon/Session.hpp>
+#include <NetCommon/MemoryPool.hpp>
+
+namespace NetCommon
+{
+    // Recycles sessions with their strands and buffers instead of freeing them on close
+    // A session comes back through the deleter of its shared_ptr, from whichever thread drops it last
+    class SessionPool
+    {
+    public:
+        using Pointer               = Session::Pointer;
+        using Id                    = Session::Id;
+        using OwnedMessageQueue     = Session::OwnedMessageQueue;
+        using CloseCallback         = Session::CloseCallback;
+        using PressureCallback      = Session::PressureCallback;
+        using DatagramBindCallback  = Session::DatagramBindCallback;
+
+    private:
+        using Tcp                   = boost::asio::ip::tcp;
+
+        // Shared with the deleters, sessions released once the pool is gone are deleted
+        struct FreeList
+        {
+            using Pointer       = std::shared_ptr<FreeList>;
+
+            std::mutex              mutex;
+            std::vector<Session*>   sessions;
+            const size_t            nMaxSessions;
+            bool                    isClosed;
+
+            explicit FreeList(size_t nMaxSessions)
+                : nMaxSessions(nMaxSessions)
+                , isClosed(false)
+            {}
+
+            bool TryPush(Session* pSession)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                if (isClosed ||
+                    (nMaxSessions > 0 && sessions.size() >= nMaxSessions))
+                {
+                    return false;
+                }
+
+                sessions.push_back(pSession);
+
+                return true;
+            }
+
+            Session* TryPop()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                if (sessions.empty())
+                {
+                    return nullptr;
+                }
+
+                Session* pSession = sessions.back();
+                sessions.pop_back();
+
+                return pSession;
+            }
+        };
+
+        struct Recycler
+        {
+            FreeList::Pointer   pFreeList;
+
+            void operator()(Session* pSession) const
+            {
+                pSession->Recycle();
+
+                if (!pFreeList->TryPush(pSession))
+                {
+                    delete pSession;
+                }
+            }
+        };
+
+    public:
+        // nMaxSessions caps the idle sessions kept, 0 keeps them all
+        SessionPool(Workers& workers,
+                    CloseCallback onSessionClosed,
+                    PressureCallback onSendQueuePressure,
+                    DatagramBindCallback onDatagramBound,
+                    SessionFeatures supportedFeatures,
+                    size_t compressionThreshold,
+                    const SendQueueLimits& sendQueueLimits,
+                    size_t nMaxInboundMessages,
+                    ServiceMetrics& metrics,
+                    size_t nMaxSessions)
+            : _workers(workers)
+            , _onSessionClosed(std::move(onSessionClosed))
+            , _onSendQueuePressure(std::move(onSendQueuePressure))
+            , _onDatagramBound(std::move(onDatagramBound))
+            , _supportedFeatures(supportedFeatures)
+            , _compressionThreshold(compressionThreshold)
+            , _sendQueueLimits(sendQueueLimits)
+            , _nMaxInboundMessages(nMaxInboundMessages)
+            , _metrics(metrics)
+            , _pFreeList(std::make_shared<FreeList>(nMaxSessions))
+        {}
+
+        SessionPool(const SessionPool&) = delete;
+        SessionPool& operator=(const SessionPool&) = delete;
+
+        // Idle sessions are deleted here, while the workers their sockets and strands belong to are still alive
+        ~SessionPool()
+        {
+            std::vector<Session*> sessions;
+
+            {
+                std::lock_guard<std::mutex> lock(_pFreeList->mutex);
+
+                _pFreeList->isClosed = true;
+                sessions.swap(_pFreeList->sessions);
+            }
+
+            for (Session* pSession : sessions)
+            {
+                delete pSession;
+            }
+        }
+
+        // Warm the pool at startup so that the first connections do not allocate
+        void Reserve(size_t nSessions)
+        {
+            for (size_t i = 0; i < nSessions; ++i)
+            {
+                if (!_pFreeList->TryPush(CreateSession()))
+                {
+                    break;
+                }
+            }
+        }
+
+        // The control block of the pointer comes from the memory pool as well
+        Pointer Acquire(Tcp::socket&& socket, Id id, OwnedMessageQueue& receiveQueue)
+        {
+            Session* pSession = _pFreeList->TryPop();
+
+            if (pSession == nullptr)
+            {
+                pSession = CreateSession();
+            }
+
+            pSession->Open(std::move(socket), id, receiveQueue);
+
+            return Pointer(pSession, Recycler{_pFreeList}, PoolAllocator<Session>());
+        }
+
+    private:
+        Session* CreateSession()
+        {
+            return new Session(_workers,
+                               _onSessionClosed,
+                               _onSendQueuePressure,
+                               _onDatagramBound,
+                               _supportedFeatures,
+                               _compressionThreshold,
+                               _sendQueueLimits,
+                               _nMaxInboundMessages,
+                               _metrics);
+        }
+
+    private:
+        Workers&                      _workers;
+        const CloseCallback           _onSessionClosed;
+        const PressureCallback        _onSendQueuePressure;
+        const DatagramBindCallback    _onDatagramBound;
+        const SessionFeatures         _supportedFeatures;
+        const size_t                  _compressionThreshold;
+        const SendQueueLimits         _sendQueueLimits;
+        const size_t                  _nMaxInboundMessages;
+        ServiceMetrics&               _metrics;
+        FreeList::Pointer             _pFreeList;
+
+    };
+}
@@ -0,0 +1,157 @@
+﻿#pragma once
+
+#include <NetCommon/Session.hpp>
+#include <NetCommon/SessionHandle.hpp>
+
+namespace NetCommon
+{
+    // Registered sessions in a fixed slot array, addressed by generational handles
+    // Add, Retire, Release and ForEach are called on the sessions strand only, the registered sessions are kept dense for ForEach
+    // Find is lock-free, a retired handle fails at once but its session is kept by the slot until Release
+    class SessionRegistry
+    {
+    public:
+        using Pointer       = Session::Pointer;
+
+    private:
+        static constexpr uint32_t   FirstGeneration     = 1;
+
+        struct Slot
+        {
+            std::atomic<SessionHandle::Value>   handle{0};
+            std::atomic<Session*>               pSession{nullptr};
+            uint32_t                            generation = FirstGeneration;
+            uint32_t                            denseIndex = 0;
+            Pointer                             pOwner;
+        };
+
+    public:
+        explicit SessionRegistry(size_t capacity)
+            : _slots(std::make_unique<Slot[]>(capacity))
+            , _capacity(capacity)
+        {
+            assert(capacity > 0 && capacity <= std::numeric_limits<uint32_t>::max());
+
+            _freeIndices.reserve(capacity);
+
+            for (size_t index = capacity; index > 0; --index)
+            {
+                _freeIndices.push_back(static_cast<uint32_t>(index - 1));
+            }
+        }
+
+        SessionRegistry(const SessionRegistry&) = delete;
+        SessionRegistry& operator=(const SessionRegistry&) = delete;
+
+        // Invalid handle when every slot is taken
+        SessionHandle Add(Pointer pSession)
+        {
+            if (_freeIndices.empty())
+            {
+                return SessionHandle();
+            }
+
+            const uint32_t index = _freeIndices.back();
+            _freeIndices.pop_back();
+
+            Slot& slot = _slots[index];
+            const SessionHandle handle(index, slot.generation);
+
+            slot.denseIndex = static_cast<uint32_t>(_denseSessions.size());
+            _denseSessions.push_back(pSession.get());
+            _denseIndices.push_back(index);
+
+            pSession->_handle = handle;
+            slot.pSession.store(pSession.get(), std::memory_order_relaxed);
+            slot.pOwner = std::move(pSession);
+            slot.handle.store(handle.GetValue(), std::memory_order_release);
+
+            return handle;
+        }
+
+        // Find fails for the handle from now on
+        void Retire(SessionHandle handle)
+        {
+            Slot& slot = _slots[handle.GetIndex()];
+
+            assert(slot.handle.load(std::memory_order_relaxed) == handle.GetValue());
+
+            slot.handle.store(0, std::memory_order_release);
+
+            const uint32_t denseIndex = slot.denseIndex;
+            const uint32_t lastIndex = _denseIndices.back();
+
+            _denseSessions[denseIndex] = _denseSessions.back();
+            _denseIndices[denseIndex] = lastIndex;
+            _slots[lastIndex].denseIndex = denseIndex;
+
+            _denseSessions.pop_back();
+            _denseIndices.pop_back();
+        }
+
+        // Drop the session of a retired handle and free its slot, no reader may still use what Find returned for it
+        void Release(SessionHandle handle)
+        {
+            const uint32_t index = handle.GetIndex();
+            Slot& slot = _slots[index];
+
+            assert(slot.handle.load(std::memory_order_relaxed) == 0 && 
+                   slot.generation == handle.GetGeneration());
+
+            slot.pSession.store(nullptr, std::memory_order_relaxed);
+            slot.pOwner.reset();
+
+            ++slot.generation;
+
+            if (slot.generation == 0)
+            {
+                slot.generation = FirstGeneration;
+            }
+
+            _freeIndices.push_back(index);
+        }
+
+        // Null for a stale handle
+        Session* Find(SessionHandle handle) const
+        {
+            if (!handle.IsValid() ||
+                handle.GetIndex() >= _capacity)
+            {
+                return nullptr;
+            }
+
+            const Slot& slot = _slots[handle.GetIndex()];
+
+            if (slot.handle.load(std::memory_order_acquire) != handle.GetValue())
+            {
+                return nullptr;
+            }
+
+            return slot.pSession.load(std::memory_order_relaxed);
+        }
+
+        template<typename TFunction>
+        void ForEach(TFunction&& function) const
+        {
+            for (Session* pSession : _denseSessions)
+            {
+                function(*pSession);
+            }
+        }
+
+        size_t GetSize() const
+        {
+            return _denseSessions.size();
+        }
+
+    private:
+        const std::unique_ptr<Slot[]>   _slots;
+        const size_t                    _capacity;
+        std::vector<uint32_t>           _freeIndices;
+
+        // Registered sessions and their slot indices, swap-removed on Retire
+        std::vector<Session*>           _denseSessions;
+        std::vector<uint32_t>           _denseIndices;
+
+    };
+}
@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/Logger.hpp>
+
+namespace NetCommon
+{
+    // Local plain-text endpoint, every connection is answered with the latest report and closed
+    // e.g. nc 127.0.0.1 <port>
+    class StatsEndpoint
+    {
+    private:
+        using Executor      = boost::asio::any_io_executor;
+        using Strand        = boost::asio::strand<Executor>;
+        using ErrorCode     = boost::system::error_code;
+        using Tcp           = boost::asio::ip::tcp;
+        using Report        = std::shared_ptr<const std::string>;
+
+    public:
+        StatsEndpoint(const Executor& executor, uint16_t port)
+            : _strand(boost::asio::make_strand(executor))
+            , _acceptor(_strand, Tcp::endpoint(boost::asio::ip::address_v4::loopback(), port))
+            , _pReport(std::make_shared<const std::string>())
+        {
+            AcceptAsync();
+        }
+
+        void SetReportAsync(std::string report)
+        {
+            boost::asio::post(_strand,
+                              [this, pReport = std::make_shared<const std::string>(std::move(report))]() mutable
+                              {
+                                  _pReport = std::move(pReport);
+                              });
+        }
+
+    private:
+        void AcceptAsync()
+        {
+            _acceptor.async_accept([this](const ErrorCode& error,
+                                          Tcp::socket socket)
+                                   {
+                                       OnAcceptCompleted(error, std::move(socket));
+                                   });
+        }
+
+        void OnAcceptCompleted(const ErrorCode& error, Tcp::socket&& socket)
+        {
+            if (error)
+            {
+                Logger::Error("[STATS] Failed to accept: ", error);
+                return;
+            }
+
+            WriteReportAsync(std::move(socket));
+            AcceptAsync();
+        }
+
+        void WriteReportAsync(Tcp::socket&& socket)
+        {
+            auto pSocket = std::make_shared<Tcp::socket>(std::move(socket));
+
+            boost::asio::async_write(*pSocket,
+                                     boost::asio::buffer(*_pReport),
+                                     [pSocket, pReport = _pReport](const ErrorCode&,
+                                                                   const size_t)
+                                     {
+                                         ErrorCode ignored;
+                                         pSocket->shutdown(Tcp::socket::shutdown_both, ignored);
+                                     });
+        }
+
+    private:
+        Strand              _strand;
+        Tcp::acceptor       _acceptor;
+        Report              _pReport;
+
+    };
+}
@@ -0,0 +1,19 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+
+namespace NetCommon
+{
+    // Dense index of the calling thread, used to pick the shard of per-thread sharded data
+    class ThreadIndex
+    {
+    public:
+        static size_t Get()
+        {
+            static std::atomic<size_t> nextIndex(0);
+            thread_local const size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+
+            return index;
+        }
+    };
+}
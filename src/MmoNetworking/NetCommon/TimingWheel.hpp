@@ -0,0 +1,270 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+
+namespace NetCommon
+{
+    // Hierarchical hashed timing wheel, Levels wheels of SlotCount slots, each slot of a level spans a whole wheel of the level below
+    // Schedule and Cancel are O(1), a timer is moved down a level at most Levels - 1 times before it fires
+    // Not thread-safe, owned by one update loop which advances it with its ticks
+    class TimingWheel
+    {
+    public:
+        using Tick          = uint64_t;
+        using Callback      = std::function<void()>;
+
+        // Stale once the timer fired or was cancelled
+        class TimerId
+        {
+            friend class TimingWheel;
+
+        public:
+            TimerId()
+                : _index(0)
+                , _generation(0)
+            {}
+
+            bool IsValid() const
+            {
+                return _generation != 0;
+            }
+
+        private:
+            TimerId(uint32_t index, uint32_t generation)
+                : _index(index)
+                , _generation(generation)
+            {}
+
+        private:
+            uint32_t    _index;
+            uint32_t    _generation;
+
+        };
+
+    private:
+        static constexpr size_t     SlotBits        = 8;
+        static constexpr size_t     SlotCount       = size_t(1) << SlotBits;
+        static constexpr size_t     SlotMask        = SlotCount - 1;
+        static constexpr size_t     Levels          = 4;
+        static constexpr Tick       MaxDelay        = (Tick(1) << (SlotBits * Levels)) - 1;
+
+        // The list heads of the slots and of the expiring list are nodes as well, so that unlinking never branches
+        static constexpr uint32_t   ExpiringHead    = Levels * SlotCount;
+        static constexpr uint32_t   FirstTimer      = ExpiringHead + 1;
+
+        struct Node
+        {
+            uint32_t    prev;
+            uint32_t    next;
+            uint32_t    generation  = 0;
+            Tick        expiry      = 0;
+            Callback    callback;
+        };
+
+    public:
+        explicit TimingWheel(size_t nReservedTimers = 0)
+            : _currentTick(0)
+            , _nTimers(0)
+        {
+            _nodes.reserve(FirstTimer + nReservedTimers);
+            _nodes.resize(FirstTimer);
+
+            for (uint32_t head = 0; head < FirstTimer; ++head)
+            {
+                _nodes[head].prev = head;
+                _nodes[head].next = head;
+            }
+        }
+
+        TimingWheel(const TimingWheel&) = delete;
+        TimingWheel& operator=(const TimingWheel&) = delete;
+
+        // Fires on the first Advance reaching the current tick + delay, at least one tick from now
+        TimerId Schedule(Tick delay, Callback callback)
+        {
+            const uint32_t index = AllocateNode();
+            Node& node = _nodes[index];
+
+            node.expiry = _currentTick + std::min(std::max<Tick>(delay, 1), MaxDelay);
+            node.callback = std::move(callback);
+            ++_nTimers;
+
+            Insert(index);
+
+            return TimerId(index, node.generation);
+        }
+
+        // False if the timer fired or was cancelled already
+        bool Cancel(TimerId timerId)
+        {
+            if (!IsPending(timerId))
+            {
+                return false;
+            }
+
+            Unlink(timerId._index);
+            FreeNode(timerId._index);
+
+            return true;
+        }
+
+        bool IsPending(TimerId timerId) const
+        {
+            return timerId.IsValid() &&
+                   timerId._index >= FirstTimer &&
+                   timerId._index < _nodes.size() &&
+                   _nodes[timerId._index].generation == timerId._generation;
+        }
+
+        // Callbacks may schedule and cancel timers, the ones scheduled run on a later tick
+        void AdvanceTo(Tick tick)
+        {
+            while (_currentTick < tick)
+            {
+                ++_currentTick;
+
+                Cascade();
+                Expire(_currentTick & SlotMask);
+            }
+        }
+
+        Tick GetCurrentTick() const
+        {
+            return _currentTick;
+        }
+
+        size_t GetSize() const
+        {
+            return _nTimers;
+        }
+
+    private:
+        static uint32_t GetHead(size_t level, size_t slot)
+        {
+            return static_cast<uint32_t>(level * SlotCount + slot);
+        }
+
+        uint32_t AllocateNode()
+        {
+            if (!_freeNodes.empty())
+            {
+                const uint32_t index = _freeNodes.back();
+                _freeNodes.pop_back();
+
+                return index;
+            }
+
+            _nodes.emplace_back();
+            _nodes.back().generation = 1;
+
+            return static_cast<uint32_t>(_nodes.size() - 1);
+        }
+
+        // Bumping the generation makes the ids of the node stale
+        void FreeNode(uint32_t index)
+        {
+            Node& node = _nodes[index];
+
+            node.callback = nullptr;
+            ++node.generation;
+
+            if (node.generation == 0)
+            {
+                node.generation = 1;
+            }
+
+            _freeNodes.push_back(index);
+            --_nTimers;
+        }
+
+        // The level is picked by the distance to the expiry, the slot by the expiry itself
+        void Insert(uint32_t index)
+        {
+            const Tick expiry = _nodes[index].expiry;
+            const Tick delay = expiry - _currentTick;
+            size_t level = 0;
+
+            while (level + 1 < Levels &&
+                   delay >= (Tick(1) << (SlotBits * (level + 1))))
+            {
+                ++level;
+            }
+
+            Link(GetHead(level, (expiry >> (SlotBits * level)) & SlotMask), index);
+        }
+
+        void Link(uint32_t head, uint32_t index)
+        {
+            Node& node = _nodes[index];
+
+            node.prev = _nodes[head].prev;
+            node.next = head;
+            _nodes[node.prev].next = index;
+            _nodes[head].prev = index;
+        }
+
+        void Unlink(uint32_t index)
+        {
+            Node& node = _nodes[index];
+
+            _nodes[node.prev].next = node.next;
+            _nodes[node.next].prev = node.prev;
+            node.prev = index;
+            node.next = index;
+        }
+
+        // Whenever a level wraps, the next slot of the level above is spread over the levels below
+        void Cascade()
+        {
+            for (size_t level = 1; level < Levels; ++level)
+            {
+                if (((_currentTick >> (SlotBits * (level - 1))) & SlotMask) != 0)
+                {
+                    return;
+                }
+
+                const uint32_t head = GetHead(level, (_currentTick >> (SlotBits * level)) & SlotMask);
+
+                while (_nodes[head].next != head)
+                {
+                    const uint32_t index = _nodes[head].next;
+
+                    Unlink(index);
+                    Insert(index);
+                }
+            }
+        }
+
+        // The slot is moved to the expiring list first, so callbacks cancelling timers of the same slot are safe
+        void Expire(size_t slot)
+        {
+            const uint32_t head = GetHead(0, slot);
+
+            while (_nodes[head].next != head)
+            {
+                const uint32_t index = _nodes[head].next;
+
+                Unlink(index);
+                Link(ExpiringHead, index);
+            }
+
+            while (_nodes[ExpiringHead].next != ExpiringHead)
+            {
+                const uint32_t index = _nodes[ExpiringHead].next;
+                Callback callback = std::move(_nodes[index].callback);
+
+                Unlink(index);
+                FreeNode(index);
+
+                callback();
+            }
+        }
+
+    private:
+        std::vector<Node>       _nodes;
+        std::vector<uint32_t>   _freeNodes;
+        Tick                    _currentTick;
+        size_t                  _nTimers;
+
+    };
+}
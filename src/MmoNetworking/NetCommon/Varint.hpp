@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+
+namespace NetCommon
+{
+    // LEB128 variable length integers and zig-zag mapping of signed integers
+    struct Varint
+    {
+        static constexpr size_t     MaxSize32       = 5;
+        static constexpr size_t     MaxSize64       = 10;
+
+        static size_t Encode(uint64_t value, std::byte* pOut)
+        {
+            size_t size = 0;
+
+            while (value >= 0x80)
+            {
+                pOut[size++] = static_cast<std::byte>((value & 0x7F) | 0x80);
+                value >>= 7;
+            }
+
+            pOut[size++] = static_cast<std::byte>(value);
+
+            return size;
+        }
+
+        // False if malformed, decodedSize is 0 if more bytes are needed
+        static bool Decode(const std::byte* pData, size_t size, uint64_t& value, size_t& decodedSize)
+        {
+            value = 0;
+            decodedSize = 0;
+
+            for (size_t index = 0; index < MaxSize64; ++index)
+            {
+                if (index == size)
+                {
+                    return true;
+                }
+
+                const uint64_t bits = static_cast<uint64_t>(pData[index]);
+                value |= (bits & 0x7F) << (7 * index);
+
+                if ((bits & 0x80) == 0)
+                {
+                    decodedSize = index + 1;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        static uint64_t EncodeZigZag(int64_t value)
+        {
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+
+        static int64_t DecodeZigZag(uint64_t value)
+        {
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+    };
+}
@@ -0,0 +1,224 @@
+﻿#pragma once
+
+#include <NetCommon/Include.hpp>
+#include <NetCommon/Logger.hpp>
+
+namespace NetCommon
+{
+    enum class ExecutionModel
+    {
+        // One thread pool runs every handler, sessions are serialized by strands
+        ThreadPool,
+        // One single-threaded io_context per thread, a session stays on one of them and needs no strands
+        IoContextPerCore
+    };
+
+    // Threads running the handlers of a service in either execution model
+    class Workers
+    {
+    public:
+        using Executor          = boost::asio::any_io_executor;
+
+    private:
+        using ThreadPool        = boost::asio::thread_pool;
+        using PoolWorkGuard     = boost::asio::executor_work_guard<ThreadPool::executor_type>;
+
+        // Handlers of a core may own sockets and timers of another core, so every core destroys
+        // its pending handlers with Shutdown before any io_context is destroyed
+        class IoContext : public boost::asio::io_context
+        {
+        public:
+            using boost::asio::io_context::io_context;
+
+            void Shutdown()
+            {
+                shutdown();
+            }
+        };
+
+        using CoreWorkGuard     = boost::asio::executor_work_guard<IoContext::executor_type>;
+
+        struct Core
+        {
+            using Pointer   = std::unique_ptr<Core>;
+            using Vector    = std::vector<Pointer>;
+
+            IoContext       ioContext;
+            CoreWorkGuard   workGuard;
+            std::thread     thread;
+
+            Core()
+                : ioContext(1)
+                , workGuard(boost::asio::make_work_guard(ioContext))
+            {}
+        };
+
+    public:
+        Workers(ExecutionModel model, size_t nThreads, bool shouldPinThreads)
+            : _model(model)
+            , _nextCoreIndex(0)
+        {
+            assert(nThreads > 0);
+
+            if (model == ExecutionModel::ThreadPool)
+            {
+                _pThreadPool = std::make_unique<ThreadPool>(nThreads);
+                _pPoolWorkGuard = std::make_unique<PoolWorkGuard>(boost::asio::make_work_guard(*_pThreadPool));
+                return;
+            }
+
+            for (size_t coreIndex = 0; coreIndex < nThreads; ++coreIndex)
+            {
+                _cores.emplace_back(std::make_unique<Core>());
+            }
+
+            for (size_t coreIndex = 0; coreIndex < nThreads; ++coreIndex)
+            {
+                Core& core = *_cores[coreIndex];
+                core.thread = std::thread([&core]()
+                                          {
+                                              core.ioContext.run();
+                                          });
+
+                if (shouldPinThreads)
+                {
+                    PinThread(core.thread, coreIndex);
+                }
+            }
+        }
+
+        Workers(const Workers&) = delete;
+        Workers& operator=(const Workers&) = delete;
+
+        ~Workers()
+        {
+            Stop();
+            Join();
+
+            for (Core::Pointer& pCore : _cores)
+            {
+                pCore->ioContext.Shutdown();
+            }
+        }
+
+        ExecutionModel GetModel() const
+        {
+            return _model;
+        }
+
+        // The pool, or the cores in turn
+        Executor GetExecutor()
+        {
+            if (_model == ExecutionModel::ThreadPool)
+            {
+                return _pThreadPool->get_executor();
+            }
+
+            return GetExecutor(_nextCoreIndex.fetch_add(1, std::memory_order_relaxed));
+        }
+
+        // The pool, or the core of the index
+        Executor GetExecutor(size_t index)
+        {
+            if (_model == ExecutionModel::ThreadPool)
+            {
+                return _pThreadPool->get_executor();
+            }
+
+            return _cores[index % _cores.size()]->ioContext.get_executor();
+        }
+
+        // Executor running its handlers one at a time, a core is already serial
+        Executor MakeSerialExecutor(const Executor& executor)
+        {
+            if (_model == ExecutionModel::ThreadPool)
+            {
+                return boost::asio::make_strand(executor);
+            }
+
+            return executor;
+        }
+
+        // Serial executor for a socket, the current strand is kept in the ThreadPool model
+        Executor RebindSerialExecutor(const Executor& currentExecutor, const Executor& socketExecutor)
+        {
+            if (_model == ExecutionModel::ThreadPool &&
+                currentExecutor)
+            {
+                return currentExecutor;
+            }
+
+            return MakeSerialExecutor(socketExecutor);
+        }
+
+        void Stop()
+        {
+            if (_model == ExecutionModel::ThreadPool)
+            {
+                _pThreadPool->stop();
+                return;
+            }
+
+            for (Core::Pointer& pCore : _cores)
+            {
+                pCore->ioContext.stop();
+            }
+        }
+
+        void Join()
+        {
+            if (_model == ExecutionModel::ThreadPool)
+            {
+                _pThreadPool->join();
+                return;
+            }
+
+            for (Core::Pointer& pCore : _cores)
+            {
+                if (pCore->thread.joinable())
+                {
+                    pCore->thread.join();
+                }
+            }
+        }
+
+    private:
+        // Best effort, the thread runs unpinned where affinity is not supported
+        static void PinThread(std::thread& thread, size_t coreIndex)
+        {
+            const size_t nCpus = std::max<size_t>(1, std::thread::hardware_concurrency());
+            const size_t cpu = coreIndex % nCpus;
+
+#if defined(_WIN32)
+            if (SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << cpu) == 0)
+            {
+                Logger::Error("[WORKERS] Failed to pin thread to cpu ", cpu);
+            }
+#elif defined(__linux__)
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(cpu, &cpuSet);
+
+            if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet) != 0)
+            {
+                Logger::Error("[WORKERS] Failed to pin thread to cpu ", cpu);
+            }
+#else
+            (void)thread;
+            (void)cpu;
+#endif
+        }
+
+    private:
+        const ExecutionModel                _model;
+
+        // ThreadPool
+        std::unique_ptr<ThreadPool>         _pThreadPool;
+        std::unique_ptr<PoolWorkGuard>      _pPoolWorkGuard;
+
+        // IoContextPerCore
+        Core::Vector                        _cores;
+        std::atomic<size_t>                 _nextCoreIndex;
+
+    };
+}
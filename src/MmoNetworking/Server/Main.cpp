@@ -1,11 +1,35 @@
 ﻿#include <Server/Pch.hpp>
 #include <Server/Service.hpp>
 
-int main()
+// Server [per-core [pin]]
+int main(int argc, char* argv[])
 {
     try
     {
-        Server::Service service(4, 0, 60000);
+        NetCommon::ServiceConfig config;
+        config.nWorkers = 4;
+
+        if (argc > 1 && std::string(argv[1]) == "per-core")
+        {
+            config.executionModel = NetCommon::ExecutionModel::IoContextPerCore;
+            config.shouldPinWorkers = (argc > 2 && std::string(argv[2]) == "pin");
+        }
+
+        config.tickRate = 60;
+        config.statsPort = 60001;
+        config.datagramPort = 60000;
+        config.nAcceptors = 4;
+        config.nPendingAccepts = 4;
+        config.nWarmSessions = 1024;
+        config.idleTimeout = NetCommon::ServiceConfig::MilliSeconds(30000);
+        config.heartbeatInterval = NetCommon::ServiceConfig::MilliSeconds(10000);
+        config.sessionFeatures = static_cast<NetCommon::SessionFeatures>(NetCommon::SessionFeature::CompactFraming) |
+                                 static_cast<NetCommon::SessionFeatures>(NetCommon::SessionFeature::Compression) |
+                                 static_cast<NetCommon::SessionFeatures>(NetCommon::SessionFeature::Chunking) |
+                                 static_cast<NetCommon::SessionFeatures>(NetCommon::SessionFeature::Heartbeat) |
+                                 static_cast<NetCommon::SessionFeatures>(NetCommon::SessionFeature::Datagram);
+
+        Server::Service service(config, 60000);
         service.Start();
 
         service.JoinWorkers();
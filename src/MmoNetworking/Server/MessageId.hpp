@@ -1,15 +1,21 @@
 ﻿#pragma once
 
 #include <NetCommon/Message.hpp>
+#include <NetCommon/MessageDispatcher.hpp>
 
 namespace Server
 {
     enum class MessageId : NetCommon::Message::Id
     {
-        Accept = 500,
+        Begin = 500,
+        Accept = Begin,
         Deny,
         Echo,
         Send,
         Broadcast,
+        End,
     };
+
+    static_assert(NetCommon::AreServiceMessageIds<MessageId>(),
+                  "Server message ids collide with the control ids or the compressed flag");
 }
@@ -1,51 +1,71 @@
 ﻿#pragma once
 
 #include <NetCommon/ServerServiceBase.hpp>
+#include <NetCommon/MessageDispatcher.hpp>
 #include <Server/MessageId.hpp>
 #include <Client/MessageId.hpp>
 
 namespace Server
 {
+    static_assert(NetCommon::AreDisjointMessageIds<Server::MessageId, Client::MessageId>(), 
+                  "Server and Client message ids collide");
+
     class Service : public NetCommon::ServerServiceBase
     {
     private:
         using Message       = NetCommon::Message;
+        using Logger        = NetCommon::Logger;
+        using Dispatcher    = NetCommon::MessageDispatcher<Service, Client::MessageId>;
 
     public:
-        Service(size_t nWorkers,
-                size_t nMaxReceivedMessages,
+        Service(const NetCommon::ServiceConfig& config,
                 uint16_t port)
-            : ServerServiceBase(nWorkers, nMaxReceivedMessages, port)
+            : ServerServiceBase(config, port)
         {}
 
     protected:
         virtual void HandleReceivedMessage(OwnedMessage receivedMessage) override
         {
-            Client::MessageId messageId = 
-                static_cast<Client::MessageId>(receivedMessage.message.header.id);
-
-            switch (messageId)
-            {
-            case Client::MessageId::Echo:
-                HandleEcho(std::move(receivedMessage.pOwner));
-                break;
-            default:
-                break;
-            }
+            GetDispatcher().Dispatch(*this, receivedMessage);
         }
 
         virtual void OnTickRateMeasured(const TickRate tickRate) override
         {
-            std::cout << "[SERVER] Tick rate: " << tickRate << "hz\n";
+            Logger::Info("[SERVER] Tick rate: ", tickRate, "hz");
         }
 
     private:
-        void HandleEcho(SessionPointer pSession)
+        static const Dispatcher& GetDispatcher()
+        {
+            static constexpr Dispatcher dispatcher = Dispatcher()
+                .Register<Client::MessageId::Echo, &Service::HandleEcho>()
+                .Register<Client::MessageId::SequencedEcho, &Service::HandleSequencedEcho>()
+                .Register<Client::MessageId::ReliableEcho, &Service::HandleReliableEcho>();
+
+            return dispatcher;
+        }
+
+        // The payload is sent back as is
+        void HandleEcho(SessionHandle handle, Message&& message)
+        {
+            message.header.id = static_cast<NetCommon::Message::Id>(MessageId::Echo);
+
+            SendMessageAsync(handle, std::move(message));
+        }
+
+        // Sent back with the delivery it came with
+        void HandleSequencedEcho(SessionHandle handle, Message&& message)
+        {
+            message.header.id = static_cast<NetCommon::Message::Id>(MessageId::Echo);
+
+            SendDatagramAsync(handle, std::move(message), NetCommon::DatagramDelivery::UnreliableSequenced);
+        }
+
+        void HandleReliableEcho(SessionHandle handle, Message&& message)
         {
-            Message message;
             message.header.id = static_cast<NetCommon::Message::Id>(MessageId::Echo);
 
-            SendMessageAsync(std::move(pSession), std::move(message));
+            SendDatagramAsync(handle, std::move(message), NetCommon::DatagramDelivery::ReliableOrdered);
         }
 
     };